@@ -0,0 +1,107 @@
+//////////////////////////////////////////////////////////////////////////
+// Asset pack benchmark
+//////////////////////////////////////////////////////////////////////////
+/*
+	Writes out 500 small assets (textures and sounds), then times loading
+	them all as loose files, and again from an asset pack of the same files
+	(including mounting it). The assets are tiny, so the time is mostly spent
+	opening and reading files rather than decoding them.
+
+	The files have just been written, so they're in the OS file cache. Run
+	with 'cold' after dropping the cache to see the difference with disk
+	reads, e.g. on Linux: sync; echo 3 | sudo tee /proc/sys/vm/drop_caches
+	Usage: asset_pack [write | cold]
+
+	Build with core.cpp and maths.cpp, linking SFML as for the library.
+*/
+
+#include "../core.h"
+#include <SFML/Audio.hpp>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const u32 ASSETS = 500;
+static const u32 TEXTURE_EVERY = 12;	// Textures are limited to 100, so most of the assets are sounds.
+static const char* PACK_PATH = "asset_pack_bench.pack";
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static std::string AssetPath(u32 i)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "asset_pack_bench_%03u.%s", i, i % TEXTURE_EVERY == 0 ? "png" : "wav");
+	return path;
+}
+
+static bool WriteAssets(const std::vector<std::string>& paths)
+{
+	sf::Image image;
+	image.create(16, 16, sf::Color::White);
+	std::vector<sf::Int16> samples(441);
+	for(u32 i = 0; i < samples.size(); ++i)
+		samples[i] = sf::Int16((i % 100) * 300);
+	sf::SoundBuffer sound;
+	sound.loadFromSamples(&samples[0], samples.size(), 1, 44100);
+
+	for(u32 i = 0; i < ASSETS; ++i)
+	{
+		bool success = i % TEXTURE_EVERY == 0 ? image.saveToFile(paths[i]) : sound.saveToFile(paths[i]);
+		if(!success)
+			return false;
+	}
+
+	std::vector<const char*> path_ptrs;
+	for(const std::string& path : paths)
+		path_ptrs.push_back(path.c_str());
+	return BuildAssetPack(PACK_PATH, &path_ptrs[0], ASSETS);
+}
+
+// Returns the time taken to load every asset, in seconds.
+static double LoadAssets(const std::vector<std::string>& paths, bool packed)
+{
+	Clock::time_point start = Clock::now();
+	if(packed && !MountAssetPack(PACK_PATH))
+		return 0;
+	for(u32 i = 0; i < ASSETS; ++i)
+	{
+		if(i % TEXTURE_EVERY == 0)
+			LoadTexture(paths[i].c_str());
+		else
+			LoadSound(paths[i].c_str());
+	}
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	const char* mode = argc > 1 ? argv[1] : "";
+	bool write = strcmp(mode, "cold") != 0;
+	bool run = strcmp(mode, "write") != 0;
+
+	SetWindowHeadless(true);
+	CoreInit();
+
+	std::vector<std::string> paths;
+	for(u32 i = 0; i < ASSETS; ++i)
+		paths.push_back(AssetPath(i));
+	if(write && !WriteAssets(paths))
+	{
+		printf("[ERR]: Couldn't write the benchmark assets\n");
+		return 1;
+	}
+
+	if(run)
+	{
+		// Loose first, as mounting the pack makes every later load come from it.
+		double loose = LoadAssets(paths, false);
+		double packed = LoadAssets(paths, true);
+		printf("%u assets: loose files %.2f ms, asset pack %.2f ms\n", ASSETS, loose * 1e3, packed * 1e3);
+
+		for(const std::string& path : paths)
+			remove(path.c_str());
+		remove(PACK_PATH);
+	}
+	return 0;
+}
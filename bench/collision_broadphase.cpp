@@ -0,0 +1,178 @@
+//////////////////////////////////////////////////////////////////////////
+// Collision broadphase benchmark
+//////////////////////////////////////////////////////////////////////////
+/*
+	Finds the colliding pairs among 1k, 10k and 100k moving circles, boxes
+	and OBBs, using the spatial hash (collision.h) and using brute force
+	(the maths.h tests on every pair), and checks both find the same pairs.
+	Objects are spread out so that density stays the same at every count.
+
+	Build with collision.cpp and maths.cpp. Doesn't open a window.
+	Usage: collision_broadphase [max brute force count, default 100000]
+	Brute force at 100k takes a few minutes, so pass 10000 for a quick run.
+*/
+
+#include "../core.h"
+#include "../collision.h"
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+static const u32 COUNTS[] = { 1000, 10000, 100000 };
+static const u32 FRAMES = 10;
+static const float AREA_PER_OBJECT = 40 * 40;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+enum class Shape { Circle, Box, OBB };
+
+struct Object
+{
+	Shape shape;
+	f2 pos;		// Circle centre, box top left or OBB start.
+	f2 extent;	// Box size or OBB end.
+	float radius;	// Circle radius or OBB width.
+	f2 vel;
+};
+
+static double Seconds(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static float RandRange(float a, float b)
+{
+	return a + (b - a) * (float(rand()) / RAND_MAX);
+}
+
+// The narrowphase tests, as a game would call them without a broadphase.
+static bool ObjectsIntersect(const Object& a, const Object& b)
+{
+	if(a.shape > b.shape)
+		return ObjectsIntersect(b, a);
+
+	switch(a.shape)
+	{
+		case Shape::Circle:
+			switch(b.shape)
+			{
+				case Shape::Circle:	return CircleCircleIntersect(a.pos, a.radius, b.pos, b.radius);
+				case Shape::Box:	return SquareCircleIntersect(b.pos, b.extent, a.pos, a.radius);
+				default:			return OBBCircleIntersect(b.pos, b.extent, b.radius, a.pos, a.radius);
+			}
+		case Shape::Box:
+			if(b.shape == Shape::Box)
+				return SquareSquareIntersect(a.pos + a.extent * 0.5f, a.extent, b.pos + b.extent * 0.5f, b.extent);
+			return OBBOBBIntersect(a.pos + f2(a.extent.x * 0.5f, 0), a.pos + f2(a.extent.x * 0.5f, a.extent.y), a.extent.x, b.pos, b.extent, b.radius);
+		default:
+			return OBBOBBIntersect(a.pos, a.extent, a.radius, b.pos, b.extent, b.radius);
+	}
+}
+
+static void MoveObjects(std::vector<Object>& objects, float world_size)
+{
+	for(Object& o : objects)
+	{
+		f2 step = o.vel;
+		if((o.pos.x + step.x < 0) || (o.pos.x + step.x > world_size))
+			o.vel.x = step.x = -step.x;
+		if((o.pos.y + step.y < 0) || (o.pos.y + step.y > world_size))
+			o.vel.y = step.y = -step.y;
+		o.pos += step;
+		if(o.shape == Shape::OBB)
+			o.extent += step;
+	}
+}
+
+static void SetCollider(ColliderId collider, const Object& o)
+{
+	switch(o.shape)
+	{
+		case Shape::Circle:	SetCircleCollider(collider, o.pos, o.radius); break;
+		case Shape::Box:	SetBoxCollider(collider, o.pos, o.extent); break;
+		default:			SetOBBCollider(collider, o.pos, o.extent, o.radius); break;
+	}
+}
+
+static void RunBenchmark(u32 count, u32 max_brute_force)
+{
+	float world_size = sqrt(count * AREA_PER_OBJECT);
+	std::vector<Object> objects(count);
+	std::vector<ColliderId> colliders(count);
+	for(u32 i = 0; i < count; ++i)
+	{
+		Object& o = objects[i];
+		o.shape = Shape(i % 3);
+		o.pos = f2(RandRange(0, world_size), RandRange(0, world_size));
+		o.vel = f2(RandRange(-2, 2), RandRange(-2, 2));
+		switch(o.shape)
+		{
+			case Shape::Circle:
+				o.radius = RandRange(2, 16);
+				colliders[i] = CreateCircleCollider(o.pos, o.radius);
+				break;
+			case Shape::Box:
+				o.extent = f2(RandRange(4, 32), RandRange(4, 32));
+				colliders[i] = CreateBoxCollider(o.pos, o.extent);
+				break;
+			default:
+				o.extent = o.pos + f2(RandRange(-24, 24), RandRange(-24, 24));
+				o.radius = RandRange(2, 12);
+				colliders[i] = CreateOBBCollider(o.pos, o.extent, o.radius);
+				break;
+		}
+	}
+
+	double update_time = 0;
+	double grid_time = 0;
+	double brute_time = 0;
+	u32 grid_pairs = 0;
+	u32 brute_pairs = 0;
+	bool brute_force = count <= max_brute_force;
+	for(u32 frame = 0; frame < FRAMES; ++frame)
+	{
+		MoveObjects(objects, world_size);
+
+		Clock::time_point start = Clock::now();
+		for(u32 i = 0; i < count; ++i)
+			SetCollider(colliders[i], objects[i]);
+		update_time += Seconds(start);
+
+		start = Clock::now();
+		const ColliderPair* pairs;
+		grid_pairs = FindCollidingPairs(&pairs);
+		grid_time += Seconds(start);
+
+		// Brute force is slow at the largest counts, so only time the first frame.
+		if(brute_force && (frame == 0 || count <= 10000))
+		{
+			start = Clock::now();
+			brute_pairs = 0;
+			for(u32 i = 0; i < count; ++i)
+			{
+				for(u32 j = i + 1; j < count; ++j)
+					brute_pairs += ObjectsIntersect(objects[i], objects[j]);
+			}
+			brute_time += Seconds(start);
+			if(brute_pairs != grid_pairs)
+				printf("[ERR]: Brute force found %u pairs, but the spatial hash found %u!\n", brute_pairs, grid_pairs);
+		}
+	}
+
+	printf("%6u objects, %5u pairs: update %7.3f ms, spatial hash %7.3f ms", count, grid_pairs, update_time * 1e3 / FRAMES, grid_time * 1e3 / FRAMES);
+	if(brute_force)
+		printf(", brute force %9.3f ms\n", brute_time * 1e3 / (count <= 10000 ? FRAMES : 1));
+	else
+		printf(", brute force skipped\n");
+
+	for(ColliderId collider : colliders)
+		DestroyCollider(collider);
+}
+
+int main(int argc, char** argv)
+{
+	u32 max_brute_force = argc > 1 ? u32(atoi(argv[1])) : 100000;
+	for(u32 count : COUNTS)
+		RunBenchmark(count, max_brute_force);
+	return 0;
+}
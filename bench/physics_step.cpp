@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////
+// Physics step benchmark
+//////////////////////////////////////////////////////////////////////////
+/*
+	Drops 5k circles and boxes into a walled pit, and times each physics
+	step while they tumble and pile up, on one core and then on all of them.
+	The target is under 4ms per step with every body awake on one core.
+
+	Set INCLUDE_PHYSICS to 1 in core.h, and build with core.cpp, maths.cpp,
+	physics.cpp, collision.cpp and jobs.cpp. Doesn't open a window.
+	Usage: physics_step [body count, default 5000]
+*/
+
+#include "../core.h"
+#include "../jobs.h"
+#include "../physics.h"
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+static const u32 STEPS = 300;
+static const u32 BODIES_PER_ROW = 150;
+static const float TIMESTEP = 1 / 60.0f;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static void RunBenchmark(u32 body_count, u32 threads)
+{
+	SetJobThreadCount(threads);
+
+	// The pit, then rows of bodies stacked above its floor.
+	std::vector<BodyId> bodies;
+	bodies.push_back(CreateBoxBody(f2(-2000, 2000), f2(40, 4000), 0));
+	bodies.push_back(CreateBoxBody(f2(5000, 2000), f2(40, 4000), 0));
+	bodies.push_back(CreateBoxBody(f2(1500, 4000), f2(7000, 40), 0));
+	for(u32 i = 0; i < body_count; ++i)
+	{
+		f2 pos(-1900 + (i % BODIES_PER_ROW) * 44.0f, 3900 - (i / BODIES_PER_ROW) * 44.0f);
+		bodies.push_back(i % 2 ? CreateCircleBody(pos, 18) : CreateBoxBody(pos, f2(36)));
+	}
+
+	double total = 0;
+	double worst = 0;
+	u32 min_awake = body_count;
+	for(u32 step = 0; step < STEPS; ++step)
+	{
+		Clock::time_point start = Clock::now();
+		PhysicsStartFrame(TIMESTEP);
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		total += ms;
+		worst = max(worst, ms);
+		min_awake = min(min_awake, GetAwakeBodyCount());
+	}
+
+	printf("%u bodies, %2u thread%s: %.3f ms average, %.3f ms worst per step (at least %u awake)\n",
+		body_count, GetJobThreadCount(), GetJobThreadCount() == 1 ? " " : "s", total / STEPS, worst, min_awake);
+
+	for(BodyId body : bodies)
+		DestroyBody(body);
+}
+
+int main(int argc, char** argv)
+{
+	u32 body_count = argc > 1 ? u32(atoi(argv[1])) : 5000;
+	SetPhysicsTimestep(TIMESTEP);
+	RunBenchmark(body_count, 1);
+	if(std::thread::hardware_concurrency() > 1)
+		RunBenchmark(body_count, std::thread::hardware_concurrency());
+	return 0;
+}
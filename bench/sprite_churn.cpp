@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////
+// Sprite churn benchmark
+//////////////////////////////////////////////////////////////////////////
+/*
+	Keeps 8k sprites alive, destroying and recreating a random batch of them
+	every frame (like bullets), and reports the cost of CreateSprite() and
+	DestroySprite() along with the frame time. Renders headless.
+
+	Build with core.cpp and maths.cpp, linking SFML as for the library.
+*/
+
+#include "../core.h"
+#include <chrono>
+#include <vector>
+
+static const u32 LIVE_SPRITES = 8000;
+static const u32 CHURN_PER_FRAME = 1000;
+static const u32 FRAMES = 600;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double Seconds(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main()
+{
+	SetWindowHeadless(true);
+	SetWindowSize(1280, 720);
+	CoreInit();
+
+	sf::Image image;
+	image.create(8, 8, sf::Color::White);
+	image.saveToFile("sprite_churn.png");
+	TextureId texture = LoadTexture("sprite_churn.png");
+	remove("sprite_churn.png");
+
+	std::vector<SpriteId> sprites(LIVE_SPRITES);
+	for(u32 i = 0; i < LIVE_SPRITES; ++i)
+	{
+		sprites[i] = CreateSprite(texture, SpriteOrigin::Centre);
+		SetPosition(sprites[i], f2(float(RandNorm() * 1280), float(RandNorm() * 720)));
+	}
+
+	double churn_time = 0;
+	double frame_time = 0;
+	u32 frames = 0;
+	while(frames < FRAMES && StartFrame())
+	{
+		Clock::time_point frame_start = Clock::now();
+
+		// Destroy and respawn a random batch. Spawning reuses slots freed this frame, so this exercises the free list.
+		Clock::time_point churn_start = Clock::now();
+		for(u32 i = 0; i < CHURN_PER_FRAME; ++i)
+		{
+			u32 slot = min(u32(RandNorm() * LIVE_SPRITES), LIVE_SPRITES - 1);
+			DestroySprite(sprites[slot]);
+			sprites[slot] = CreateSprite(texture, SpriteOrigin::Centre);
+		}
+		churn_time += Seconds(churn_start);
+
+		for(u32 i = 0; i < LIVE_SPRITES; ++i)
+			SetPosition(sprites[i], f2(float(RandNorm() * 1280), float(RandNorm() * 720)));
+		DrawSprites(&sprites[0], LIVE_SPRITES);
+
+		frame_time += Seconds(frame_start);
+		++frames;
+	}
+
+	printf("%u live sprites, %u destroyed and created per frame, %u frames\n", LIVE_SPRITES, CHURN_PER_FRAME, frames);
+	printf("Create + destroy: %.1f ns per pair\n", churn_time * 1e9 / (double(frames) * CHURN_PER_FRAME));
+	printf("Frame (excluding present): %.3f ms\n", frame_time * 1e3 / frames);
+	return 0;
+}
@@ -0,0 +1,77 @@
+//////////////////////////////////////////////////////////////////////////
+// Text batching benchmark
+//////////////////////////////////////////////////////////////////////////
+/*
+	Draws 10k short strings a frame offscreen, like a screen full of damage
+	numbers, first with batching disabled (a draw call per string) and then
+	enabled. Reports the draw calls and frame time of each from the render
+	stats. Renders headless.
+
+	Build with core.cpp and maths.cpp, linking SFML as for the library.
+	Usage: text_batching <font file>
+*/
+
+#include "../core.h"
+#include <chrono>
+
+static const u32 STRINGS = 10000;
+static const u32 WARMUP_FRAMES = 60;
+static const u32 MEASURED_FRAMES = 60;	// The render stats history covers the last 60 frames.
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static void DrawStrings(FontId font)
+{
+	char text[16];
+	for(u32 i = 0; i < STRINGS; ++i)
+	{
+		snprintf(text, sizeof(text), "%u", (i * 7919) % 1000);
+		f2 pos(float((i * 37) % 1280), float((i * 53) % 720));
+		DrawText(text, font, pos, 16, f4(1, 0.8f, 0.2f, 1));
+	}
+}
+
+// Returns the average frame time over the measured frames, in seconds.
+static double RunFrames(FontId font)
+{
+	Clock::time_point start;
+	for(u32 frame = 0; frame < WARMUP_FRAMES + MEASURED_FRAMES; ++frame)
+	{
+		StartFrame();
+		if(frame == WARMUP_FRAMES)
+			start = Clock::now();
+		DrawStrings(font);
+	}
+
+	// Present the last frame, so its stats are recorded.
+	StartFrame();
+	return std::chrono::duration<double>(Clock::now() - start).count() / MEASURED_FRAMES;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		printf("Usage: text_batching <font file>\n");
+		return 1;
+	}
+
+	SetWindowHeadless(true);
+	SetWindowSize(1280, 720);
+	CoreInit();
+
+	FontId font = LoadFont(argv[1]);
+	if(font == FontId(-1))
+		return 1;
+
+	printf("%u strings per frame\n", STRINGS);
+	for(int batching = 0; batching < 2; ++batching)
+	{
+		SetBatchingEnabled(batching != 0);
+		double frame_time = RunFrames(font);
+		RenderStats stats = GetRenderStatsAvg();
+		printf("Batching %-3s: %6u draw calls, %6u saved, %.3f ms per frame\n",
+			batching ? "on" : "off", stats.draw_calls, stats.draw_calls_saved, frame_time * 1e3);
+	}
+	return 0;
+}
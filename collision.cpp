@@ -0,0 +1,487 @@
+#include "core.h"
+#include "collision.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+// Internal types
+//////////////////////////////////////////////////////////////////////////
+
+enum class ColliderShape : u8 { None, Circle, Box, OBB };
+
+// Inclusive range of grid cells covered by a collider.
+struct CellRange
+{
+	int x0, y0, x1, y1;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Internal state
+//////////////////////////////////////////////////////////////////////////
+
+static const u32			COLLIDER_INDEX_BITS = 20;
+static const u32			COLLIDER_INDEX_MASK = (1 << COLLIDER_INDEX_BITS) - 1;
+static const u32			MAX_COLLIDERS = COLLIDER_INDEX_MASK;	// The all-ones index is left unused, so -1 is never a valid ID.
+static const u32			NO_FREE_COLLIDER = u32(-1);
+static const u32			GRID_BUCKETS = 1 << 14;
+static const u32			MAX_COLLIDER_CELLS = 64;	// Colliders covering more cells than this are kept out of the grid.
+
+// Colliders
+static std::vector<ColliderShape>	g_collider_shapes;
+static std::vector<f2>				g_collider_positions;	// Circle centre, box top left, or OBB start.
+static std::vector<f2>				g_collider_extents;		// Box size, or OBB end.
+static std::vector<float>			g_collider_radii;		// Circle radius, or OBB width.
+static std::vector<f2>				g_collider_mins;		// Bounding boxes.
+static std::vector<f2>				g_collider_maxs;
+static std::vector<CellRange>		g_collider_cells;
+static std::vector<bool>			g_collider_large;
+static std::vector<u16>				g_collider_generations;
+static std::vector<u32>				g_collider_next_free;
+static std::vector<u32>				g_collider_stamps;		// Last query that visited each collider, to skip duplicates.
+static u32							g_collider_free_head = NO_FREE_COLLIDER;
+static u32							g_total_colliders = 0;	// High-water mark of slots handed out.
+
+// Spatial hash
+static float				g_cell_size = 64;
+static std::vector<u32>		g_grid[GRID_BUCKETS];	// Collider slots in each bucket of cells.
+static std::vector<u32>		g_large_colliders;
+static u32					g_query_stamp = 0;
+
+// Query results
+static std::vector<ColliderPair>	g_candidate_pairs;
+static std::vector<ColliderPair>	g_colliding_pairs;
+
+//////////////////////////////////////////////////////////////////////////
+// Spatial hash
+//////////////////////////////////////////////////////////////////////////
+
+static u32 GetGridBucketIndex(int x, int y)
+{
+	return (u32(x) * 73856093u ^ u32(y) * 19349663u) & (GRID_BUCKETS - 1);
+}
+
+static std::vector<u32>& GetGridBucket(int x, int y)
+{
+	return g_grid[GetGridBucketIndex(x, y)];
+}
+
+static CellRange GetCellRange(f2 min_pos, f2 max_pos)
+{
+	CellRange range;
+	range.x0 = int(floor(min_pos.x / g_cell_size));
+	range.y0 = int(floor(min_pos.y / g_cell_size));
+	range.x1 = int(floor(max_pos.x / g_cell_size));
+	range.y1 = int(floor(max_pos.y / g_cell_size));
+	return range;
+}
+
+static u64 GetCellCount(const CellRange& range)
+{
+	return u64(range.x1 - range.x0 + 1) * u64(range.y1 - range.y0 + 1);
+}
+
+static void InsertIntoGrid(u32 idx)
+{
+	const CellRange& range = g_collider_cells[idx];
+	if(g_collider_large[idx])
+	{
+		g_large_colliders.push_back(idx);
+		return;
+	}
+
+	// Cells can share a bucket, but a collider is only listed once in each.
+	for(int y = range.y0; y <= range.y1; ++y)
+	{
+		for(int x = range.x0; x <= range.x1; ++x)
+		{
+			std::vector<u32>& bucket = GetGridBucket(x, y);
+			if(bucket.empty() || bucket.back() != idx)
+				bucket.push_back(idx);
+		}
+	}
+}
+
+static void RemoveFromList(std::vector<u32>& list, u32 idx)
+{
+	for(u32& entry : list)
+	{
+		if(entry == idx)
+		{
+			entry = list.back();
+			list.pop_back();
+			return;
+		}
+	}
+}
+
+static void RemoveFromGrid(u32 idx)
+{
+	const CellRange& range = g_collider_cells[idx];
+	if(g_collider_large[idx])
+	{
+		RemoveFromList(g_large_colliders, idx);
+		return;
+	}
+
+	for(int y = range.y0; y <= range.y1; ++y)
+		for(int x = range.x0; x <= range.x1; ++x)
+			RemoveFromList(GetGridBucket(x, y), idx);
+}
+
+// Recalculates a collider's bounding box, moving it between grid cells if necessary.
+static void UpdateCollider(u32 idx, bool inserted)
+{
+	f2 pos = g_collider_positions[idx];
+	f2 extent = g_collider_extents[idx];
+	float radius = g_collider_radii[idx];
+	switch(g_collider_shapes[idx])
+	{
+		case ColliderShape::Circle:
+			g_collider_mins[idx] = pos - f2(radius);
+			g_collider_maxs[idx] = pos + f2(radius);
+			break;
+		case ColliderShape::Box:
+			g_collider_mins[idx] = min(pos, pos + extent);
+			g_collider_maxs[idx] = max(pos, pos + extent);
+			break;
+		case ColliderShape::OBB:
+		{
+			f2 corners[4];
+			GetOBBCorners(pos, extent, radius, corners);
+			g_collider_mins[idx] = min(min(corners[0], corners[1]), min(corners[2], corners[3]));
+			g_collider_maxs[idx] = max(max(corners[0], corners[1]), max(corners[2], corners[3]));
+			break;
+		}
+		default:
+			break;
+	}
+
+	// Only touch the grid if the collider has crossed into different cells.
+	CellRange range = GetCellRange(g_collider_mins[idx], g_collider_maxs[idx]);
+	const CellRange& old_range = g_collider_cells[idx];
+	if(inserted && range.x0 == old_range.x0 && range.y0 == old_range.y0 && range.x1 == old_range.x1 && range.y1 == old_range.y1)
+		return;
+
+	if(inserted)
+		RemoveFromGrid(idx);
+	g_collider_cells[idx] = range;
+	g_collider_large[idx] = GetCellCount(range) > MAX_COLLIDER_CELLS;
+	InsertIntoGrid(idx);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Colliders
+//////////////////////////////////////////////////////////////////////////
+
+static ColliderId GetColliderId(u32 idx)
+{
+	return (ColliderId(g_collider_generations[idx]) << COLLIDER_INDEX_BITS) | idx;
+}
+
+// Returns the slot for a collider, or MAX_COLLIDERS (reporting an error) if the ID is invalid.
+static u32 GetColliderIndex(ColliderId collider)
+{
+	u32 idx = collider & COLLIDER_INDEX_MASK;
+	if(idx >= g_total_colliders || g_collider_shapes[idx] == ColliderShape::None || g_collider_generations[idx] != (collider >> COLLIDER_INDEX_BITS))
+	{
+		printf("[ERR]: Invalid collider ID!\n");
+		return MAX_COLLIDERS;
+	}
+	return idx;
+}
+
+static ColliderId CreateCollider(ColliderShape shape, f2 pos, f2 extent, float radius)
+{
+	// Reuse a destroyed slot if there is one, otherwise take a fresh one.
+	u32 idx;
+	if(g_collider_free_head != NO_FREE_COLLIDER)
+	{
+		idx = g_collider_free_head;
+		g_collider_free_head = g_collider_next_free[idx];
+	}
+	else if(g_total_colliders < MAX_COLLIDERS)
+	{
+		idx = g_total_colliders++;
+		g_collider_shapes.push_back(ColliderShape::None);
+		g_collider_positions.push_back(f2(0));
+		g_collider_extents.push_back(f2(0));
+		g_collider_radii.push_back(0);
+		g_collider_mins.push_back(f2(0));
+		g_collider_maxs.push_back(f2(0));
+		g_collider_cells.push_back(CellRange());
+		g_collider_large.push_back(false);
+		g_collider_generations.push_back(0);
+		g_collider_next_free.push_back(NO_FREE_COLLIDER);
+		g_collider_stamps.push_back(0);
+	}
+	else
+	{
+		printf("[ERR]: Out of collider memory!\n");
+		return -1;
+	}
+
+	g_collider_shapes[idx] = shape;
+	g_collider_positions[idx] = pos;
+	g_collider_extents[idx] = extent;
+	g_collider_radii[idx] = radius;
+	UpdateCollider(idx, false);
+	return GetColliderId(idx);
+}
+
+static void SetCollider(ColliderId collider, ColliderShape shape, f2 pos, f2 extent, float radius)
+{
+	u32 idx = GetColliderIndex(collider);
+	if(idx == MAX_COLLIDERS)
+		return;
+
+	g_collider_shapes[idx] = shape;
+	g_collider_positions[idx] = pos;
+	g_collider_extents[idx] = extent;
+	g_collider_radii[idx] = radius;
+	UpdateCollider(idx, true);
+}
+
+// Runs the exact intersection test for a pair of colliders.
+static bool ShapesIntersect(u32 a, u32 b)
+{
+	if(g_collider_shapes[a] > g_collider_shapes[b])
+		std::swap(a, b);
+
+	f2 pos_a = g_collider_positions[a], extent_a = g_collider_extents[a];
+	f2 pos_b = g_collider_positions[b], extent_b = g_collider_extents[b];
+	float radius_a = g_collider_radii[a], radius_b = g_collider_radii[b];
+
+	switch(g_collider_shapes[a])
+	{
+		case ColliderShape::Circle:
+			switch(g_collider_shapes[b])
+			{
+				case ColliderShape::Circle:	return CircleCircleIntersect(pos_a, radius_a, pos_b, radius_b);
+				case ColliderShape::Box:	return SquareCircleIntersect(pos_b, extent_b, pos_a, radius_a);
+				default:					return OBBCircleIntersect(pos_b, extent_b, radius_b, pos_a, radius_a);
+			}
+		case ColliderShape::Box:
+			if(g_collider_shapes[b] == ColliderShape::Box)
+				return SquareSquareIntersect(pos_a + extent_a * 0.5f, extent_a, pos_b + extent_b * 0.5f, extent_b);
+
+			// Treat the box as an OBB running down its middle.
+			return OBBOBBIntersect(pos_a + f2(extent_a.x * 0.5f, 0), pos_a + f2(extent_a.x * 0.5f, extent_a.y), extent_a.x, pos_b, extent_b, radius_b);
+		default:
+			return OBBOBBIntersect(pos_a, extent_a, radius_a, pos_b, extent_b, radius_b);
+	}
+}
+
+static bool BoundsOverlap(u32 a, u32 b)
+{
+	return g_collider_mins[a].x <= g_collider_maxs[b].x && g_collider_mins[b].x <= g_collider_maxs[a].x
+		&& g_collider_mins[a].y <= g_collider_maxs[b].y && g_collider_mins[b].y <= g_collider_maxs[a].y;
+}
+
+// Starts a new pass over the colliders. Stamps are cleared when the stamp wraps, so stale ones can't match the new pass.
+static void NextQueryStamp()
+{
+	if(++g_query_stamp == 0)
+	{
+		std::fill(g_collider_stamps.begin(), g_collider_stamps.end(), 0u);
+		g_query_stamp = 1;
+	}
+}
+
+// Records a candidate pair, if their bounding boxes overlap.
+static void AddCandidatePair(u32 a, u32 b)
+{
+	if(BoundsOverlap(a, b))
+	{
+		ColliderPair pair = { GetColliderId(min(a, b)), GetColliderId(max(a, b)) };
+		g_candidate_pairs.push_back(pair);
+	}
+}
+
+// Records a pair found in a grid bucket. Colliders can share several cells, so the pair is only kept from the
+// bucket of the first cell they share.
+static void AddBucketPair(u32 bucket, u32 a, u32 b)
+{
+	if(!BoundsOverlap(a, b))
+		return;
+
+	const CellRange& range_a = g_collider_cells[a];
+	const CellRange& range_b = g_collider_cells[b];
+	if(GetGridBucketIndex(max(range_a.x0, range_b.x0), max(range_a.y0, range_b.y0)) != bucket)
+		return;
+
+	ColliderPair pair = { GetColliderId(min(a, b)), GetColliderId(max(a, b)) };
+	g_candidate_pairs.push_back(pair);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public collision API
+//////////////////////////////////////////////////////////////////////////
+
+ColliderId CreateCircleCollider(f2 pos, float radius)
+{
+	return CreateCollider(ColliderShape::Circle, pos, f2(0), radius);
+}
+
+ColliderId CreateBoxCollider(f2 pos, f2 size)
+{
+	return CreateCollider(ColliderShape::Box, pos, size, 0);
+}
+
+ColliderId CreateOBBCollider(f2 start, f2 end, float width)
+{
+	return CreateCollider(ColliderShape::OBB, start, end, width);
+}
+
+void DestroyCollider(ColliderId collider)
+{
+	u32 idx = GetColliderIndex(collider);
+	if(idx == MAX_COLLIDERS)
+		return;
+
+	RemoveFromGrid(idx);
+	g_collider_shapes[idx] = ColliderShape::None;
+
+	// Bumping the generation invalidates any IDs still referring to this slot.
+	g_collider_generations[idx] = (g_collider_generations[idx] + 1) & ((1 << (32 - COLLIDER_INDEX_BITS)) - 1);
+	g_collider_next_free[idx] = g_collider_free_head;
+	g_collider_free_head = idx;
+}
+
+void SetCircleCollider(ColliderId collider, f2 pos, float radius)
+{
+	SetCollider(collider, ColliderShape::Circle, pos, f2(0), radius);
+}
+
+void SetBoxCollider(ColliderId collider, f2 pos, f2 size)
+{
+	SetCollider(collider, ColliderShape::Box, pos, size, 0);
+}
+
+void SetOBBCollider(ColliderId collider, f2 start, f2 end, float width)
+{
+	SetCollider(collider, ColliderShape::OBB, start, end, width);
+}
+
+void SetCollisionCellSize(float size)
+{
+	if(size <= 0)
+	{
+		printf("[ERR]: Collision cell size must be positive!\n");
+		return;
+	}
+
+	// Rebuild the grid with the new cells.
+	for(std::vector<u32>& bucket : g_grid)
+		bucket.clear();
+	g_large_colliders.clear();
+
+	g_cell_size = size;
+	for(u32 i = 0; i < g_total_colliders; ++i)
+	{
+		if(g_collider_shapes[i] != ColliderShape::None)
+			UpdateCollider(i, false);
+	}
+}
+
+u32 FindCandidatePairs(const ColliderPair** pairs)
+{
+	g_candidate_pairs.clear();
+
+	// Test the colliders sharing each bucket against each other, rather than each collider against its neighbours,
+	// so nothing needs marking as visited.
+	for(u32 bucket = 0; bucket < GRID_BUCKETS; ++bucket)
+	{
+		const std::vector<u32>& colliders = g_grid[bucket];
+		for(u32 i = 0; i + 1 < colliders.size(); ++i)
+		{
+			for(u32 j = i + 1; j < colliders.size(); ++j)
+				AddBucketPair(bucket, colliders[i], colliders[j]);
+		}
+	}
+
+	// Large colliders aren't in the grid, so test them against everything.
+	for(u32 i = 0; i < g_large_colliders.size(); ++i)
+	{
+		u32 large = g_large_colliders[i];
+		for(u32 j = 0; j < g_total_colliders; ++j)
+		{
+			if(g_collider_shapes[j] != ColliderShape::None && !g_collider_large[j])
+				AddCandidatePair(large, j);
+		}
+		for(u32 j = i + 1; j < g_large_colliders.size(); ++j)
+			AddCandidatePair(large, g_large_colliders[j]);
+	}
+
+	*pairs = g_candidate_pairs.empty() ? nullptr : &g_candidate_pairs[0];
+	return u32(g_candidate_pairs.size());
+}
+
+u32 FindCollidingPairs(const ColliderPair** pairs)
+{
+	const ColliderPair* candidates;
+	u32 candidate_count = FindCandidatePairs(&candidates);
+
+	g_colliding_pairs.clear();
+	for(u32 i = 0; i < candidate_count; ++i)
+	{
+		if(ShapesIntersect(candidates[i].a & COLLIDER_INDEX_MASK, candidates[i].b & COLLIDER_INDEX_MASK))
+			g_colliding_pairs.push_back(candidates[i]);
+	}
+
+	*pairs = g_colliding_pairs.empty() ? nullptr : &g_colliding_pairs[0];
+	return u32(g_colliding_pairs.size());
+}
+
+u32 QueryColliders(f2 pos, f2 size, ColliderId* colliders, u32 max_colliders)
+{
+	f2 min_pos = min(pos, pos + size);
+	f2 max_pos = max(pos, pos + size);
+	u32 count = 0;
+	NextQueryStamp();
+
+	auto visit = [&](u32 idx)
+	{
+		if(count == max_colliders || g_collider_stamps[idx] == g_query_stamp)
+			return;
+		g_collider_stamps[idx] = g_query_stamp;
+
+		if(g_collider_mins[idx].x <= max_pos.x && min_pos.x <= g_collider_maxs[idx].x
+			&& g_collider_mins[idx].y <= max_pos.y && min_pos.y <= g_collider_maxs[idx].y)
+			colliders[count++] = GetColliderId(idx);
+	};
+
+	// Regions covering more cells than there are colliders are quicker to check collider by collider.
+	CellRange range = GetCellRange(min_pos, max_pos);
+	if(GetCellCount(range) > g_total_colliders)
+	{
+		for(u32 i = 0; i < g_total_colliders; ++i)
+		{
+			if(g_collider_shapes[i] != ColliderShape::None)
+				visit(i);
+		}
+		return count;
+	}
+
+	for(int y = range.y0; y <= range.y1; ++y)
+	{
+		for(int x = range.x0; x <= range.x1; ++x)
+		{
+			for(u32 idx : GetGridBucket(x, y))
+				visit(idx);
+		}
+	}
+	for(u32 idx : g_large_colliders)
+		visit(idx);
+	return count;
+}
+
+bool CollidersIntersect(ColliderId a, ColliderId b)
+{
+	u32 idx_a = GetColliderIndex(a);
+	u32 idx_b = GetColliderIndex(b);
+	if(idx_a == MAX_COLLIDERS || idx_b == MAX_COLLIDERS)
+		return false;
+
+	return BoundsOverlap(idx_a, idx_b) && ShapesIntersect(idx_a, idx_b);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Overview
+//////////////////////////////////////////////////////////////////////////
+/*
+	A broadphase collision library, for finding which of many shapes
+	overlap without testing every pair.
+
+	Colliders are stored in a uniform grid spatial hash. Moving a collider
+	only touches the grid if it has crossed into different cells, so
+	updating every collider each frame is cheap. Pairs whose bounding boxes
+	share a cell are the candidates, and the exact intersection tests from
+	maths.h are run on those.
+
+	The cell size should be around the size of a typical collider. Colliders
+	spanning too many cells are kept out of the grid and tested against
+	everything, so occasional large ones are fine.
+*/
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+typedef u32 ColliderId;	// Slot index in the low 20 bits, slot generation in the high 12 bits.
+
+struct ColliderPair
+{
+	ColliderId a;
+	ColliderId b;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Public collision API
+//////////////////////////////////////////////////////////////////////////
+
+// Colliders.
+ColliderId	CreateCircleCollider(f2 pos, float radius);
+ColliderId	CreateBoxCollider(f2 pos, f2 size);					// Axis aligned, positioned by its top left corner (like DrawQuad).
+ColliderId	CreateOBBCollider(f2 start, f2 end, float width);	// Oriented along the line from start to end (like the line overload of DrawQuad).
+void		DestroyCollider(ColliderId collider);
+void		SetCircleCollider(ColliderId collider, f2 pos, float radius);
+void		SetBoxCollider(ColliderId collider, f2 pos, f2 size);
+void		SetOBBCollider(ColliderId collider, f2 start, f2 end, float width);
+void		SetCollisionCellSize(float size);	// Defaults to 64.
+
+// Queries. Returned pairs stay valid until the next query, and come out in the same order for the same colliders.
+u32			FindCandidatePairs(const ColliderPair** pairs);	// Pairs whose bounding boxes overlap.
+u32			FindCollidingPairs(const ColliderPair** pairs);	// Candidate pairs whose shapes actually intersect.
+u32			QueryColliders(f2 pos, f2 size, ColliderId* colliders, u32 max_colliders);	// Colliders whose bounding boxes overlap the region.
+bool		CollidersIntersect(ColliderId a, ColliderId b);
@@ -2,11 +2,38 @@
 #include <SFML/Audio.hpp>
 #include <SFML/Graphics.hpp>
 #include <SFML/Window.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #if INCLUDE_GAMEPAD_LIBRARY
 #include "gamepad.h"
 #endif
 
+#if INCLUDE_PHYSICS
+#include "physics.h"
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 // Internal types
 //////////////////////////////////////////////////////////////////////////
@@ -19,6 +46,331 @@ struct FontState
 	f4 col;
 };
 
+struct TextRun
+{
+	u64 key;
+	std::string text;
+	std::vector<sf::Vertex> vertices; // Laid out relative to the draw position, with scale and alignment applied.
+	u32 bytes;
+};
+
+struct SkylineNode
+{
+	int x, y, width;
+};
+
+enum class AsyncLoadType { Texture, Sound };
+
+struct AsyncLoad
+{
+	AsyncLoadType type;
+	u16 id;
+	std::string path;
+	const u8* packed_data;	// Where the file is in a mounted asset pack, or null to read it from disk.
+	u32 packed_size;
+	bool success;
+
+	// Decoded on a worker thread, uploaded on the main thread.
+	sf::Image image;
+	std::vector<sf::Int16> samples;
+	u32 channel_count;
+	u32 sample_rate;
+};
+
+// Worker threads decoding asset files in the background. Owns its threads, so they are joined on shutdown.
+struct AsyncLoader
+{
+	std::vector<std::thread>	workers;
+	std::mutex					mutex;
+	std::condition_variable		wake;
+	std::deque<AsyncLoad*>		requests;
+	std::deque<AsyncLoad*>		results;
+	bool						quitting = false;
+
+	~AsyncLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quitting = true;
+		}
+		wake.notify_all();
+		for(std::thread& worker : workers)
+			worker.join();
+		for(AsyncLoad* load : requests)
+			delete load;
+		for(AsyncLoad* load : results)
+			delete load;
+	}
+};
+
+struct LayerSprite
+{
+	const sf::Texture* texture;
+	sf::Vertex quad[4];
+};
+
+struct ShaderReload
+{
+	ShaderId shader;
+	std::string source;
+};
+
+// Background thread watching shader files for changes, and reading their new source.
+struct ShaderWatcher
+{
+	std::thread					thread;
+	std::mutex					mutex;
+	std::condition_variable		wake;
+	std::vector<std::string>	paths;		// Indexed by ShaderId, empty for shaders not loaded from files.
+	std::vector<ShaderReload>	reloads;	// Source read by the watcher, waiting to be compiled on the main thread.
+	bool						quitting = false;
+
+	~ShaderWatcher()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quitting = true;
+		}
+		wake.notify_all();
+		if(thread.joinable())
+			thread.join();
+	}
+};
+
+// A read-only view of a whole file. Memory mapped where possible, so only the parts that are used get read in.
+struct MappedFile
+{
+	const u8* data = nullptr;
+	size_t size = 0;
+	std::string contents;	// The file's contents, where memory mapping isn't available.
+
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	bool open(const char* path)
+	{
+		close();
+	#if defined(__unix__) || defined(__APPLE__)
+		int fd = ::open(path, O_RDONLY);
+		if(fd < 0)
+			return false;
+
+		struct stat info;
+		void* mapping = MAP_FAILED;
+		if(fstat(fd, &info) == 0 && info.st_size > 0)
+			mapping = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(mapping == MAP_FAILED)
+			return false;
+
+		data = (const u8*)mapping;
+		size = size_t(info.st_size);
+		return true;
+	#else
+		FILE* file = fopen(path, "rb");
+		if(!file)
+			return false;
+
+		char buffer[4096];
+		size_t read;
+		while((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+			contents.append(buffer, read);
+		bool success = !ferror(file);
+		fclose(file);
+
+		data = (const u8*)contents.data();
+		size = contents.size();
+		return success;
+	#endif
+	}
+
+	void close()
+	{
+	#if defined(__unix__) || defined(__APPLE__)
+		if(data)
+			munmap((void*)data, size);
+	#endif
+		data = nullptr;
+		size = 0;
+		contents.clear();
+	}
+};
+
+// Sound bank files: a header, then an index entry per sound, then the sounds' files as they were on disk.
+static const u32 SOUND_BANK_MAGIC = 0x4B4E4253;	// "SBNK"
+static const u32 SOUND_BANK_VERSION = 1;
+
+struct SoundBankHeader
+{
+	u32 magic;
+	u32 version;
+	u32 sound_count;
+};
+
+struct SoundBankEntry
+{
+	u32 offset;	// From the start of the file.
+	u32 size;
+};
+
+// Asset pack files: a header, then an index entry per asset, then the assets' paths, then their files as they were on disk.
+static const u32 ASSET_PACK_MAGIC = 0x4B415041;	// "APAK"
+static const u32 ASSET_PACK_VERSION = 1;
+
+struct AssetPackHeader
+{
+	u32 magic;
+	u32 version;
+	u32 asset_count;
+};
+
+struct AssetPackEntry
+{
+	u64 path_hash;		// FNV-1a of the normalised path.
+	u32 path_offset;	// From the start of the file, as are the file offsets.
+	u32 path_size;
+	u32 offset;
+	u32 size;
+};
+
+// Where a packed asset's file is in its mapped pack.
+struct PackedAsset
+{
+	const char* path;
+	u32 path_size;
+	const u8* data;
+	u32 size;
+};
+
+// Streams a music file, decoding a small chunk at a time on SFML's streaming thread. Loops by reading straight on
+// from the start of the file, so there's no gap at the loop point.
+struct MusicStream : public sf::SoundStream
+{
+	sf::InputSoundFile file;
+	std::vector<sf::Int16> samples;
+	std::atomic<bool> looping{false};	// Read by the streaming thread.
+
+	~MusicStream()
+	{
+		// The streaming thread calls back into this class, so must finish before it is destroyed.
+		stop();
+	}
+
+	bool open(const char* path)
+	{
+		return file.openFromFile(path) && initChunks();
+	}
+
+	bool open(const u8* data, u32 size)
+	{
+		return file.openFromMemory(data, size) && initChunks();
+	}
+
+	bool initChunks()
+	{
+		// A quarter of a second per chunk. SFML queues three chunks, so music needs little memory however long it is.
+		u32 channels = file.getChannelCount();
+		samples.resize(max(file.getSampleRate() / 4, 1u) * channels);
+		initialize(channels, file.getSampleRate());
+		return true;
+	}
+
+	bool onGetData(Chunk& data) override
+	{
+		u64 count = file.read(&samples[0], samples.size());
+		while(looping && count < samples.size())
+		{
+			file.seek(u64(0));
+			u64 read = file.read(&samples[count], samples.size() - count);
+			if(read == 0)
+				break;
+			count += read;
+		}
+
+		data.samples = &samples[0];
+		data.sampleCount = size_t(count);
+		return count == samples.size();
+	}
+
+	void onSeek(sf::Time offset) override
+	{
+		file.seek(offset);
+	}
+};
+
+static const u32 MIXER_SAMPLE_RATE = 44100;
+static const u32 MIXER_CHUNK_FRAMES = 1024;	// About 23ms, with SFML queueing three chunks ahead.
+
+// Plays the software mixer's output, mixing each chunk on SFML's streaming thread.
+struct MixerStream : public sf::SoundStream
+{
+	std::vector<float> mix;
+	std::vector<sf::Int16> samples;
+
+	~MixerStream()
+	{
+		stop();
+	}
+
+	void start()
+	{
+		if(samples.empty())
+		{
+			mix.resize(MIXER_CHUNK_FRAMES * 2);
+			samples.resize(MIXER_CHUNK_FRAMES * 2);
+			initialize(2, MIXER_SAMPLE_RATE);
+		}
+		play();
+	}
+
+	bool onGetData(Chunk& data) override;	// Defined with the sound API.
+
+	void onSeek(sf::Time) override
+	{
+	}
+};
+
+static const u32 PARTICLE_CURVE_SAMPLES = 256;
+
+// A particle emitter, with its particles stored one array per attribute so the update loops stream through memory.
+struct ParticleEmitter
+{
+	bool live;
+	ParticleSettings settings;
+	f2 pos;
+	float spawn_accumulator;			// Fractional particles owed by the emission rate.
+	float colour_curve[PARTICLE_CURVE_SAMPLES + 1];	// The settings' easing curves, sampled over a particle's life.
+	float size_curve[PARTICLE_CURVE_SAMPLES + 1];
+
+	// Live particles are packed at the front of each array.
+	u32 count;
+	std::vector<float> pos_x, pos_y;
+	std::vector<float> vel_x, vel_y;
+	std::vector<float> ages, inv_lives;
+	std::vector<sf::Color> colours;
+	std::vector<float> sizes;
+	std::vector<sf::Vertex> vertices;	// Kept between frames, rather than going through the batch, to save constructing a million vertices a frame.
+};
+
+enum class UniformType { None, Float, Vec2, Vec3, Vec4, Texture, Matrix };	// None until the uniform is first set.
+
+// Cached value of a shader uniform, uploaded when the shader is next used.
+struct UniformSlot
+{
+	std::string name;
+	UniformType type;
+	bool dirty;
+	float values[9];
+	TextureId texture;
+	const sf::Texture* bound_texture;	// Source texture last uploaded, which changes once an async texture loads.
+};
+
 //////////////////////////////////////////////////////////////////////////
 // Internal state
 //////////////////////////////////////////////////////////////////////////
@@ -36,10 +388,15 @@ static bool				g_window_mouse_visible = true;
 static f4				g_window_clear_col = f4(0, 0, 0, 1);
 static bool				g_window_fullscreen = false;
 static bool				g_window_antialiased = false;
+static bool				g_window_headless = false;
 static TitlebarStyle	g_window_titlebar_style = TitlebarStyle::Full;
 
 // Window
 static sf::RenderWindow	g_window;
+static sf::RenderTexture	g_scene_targets[2];	// Ping-pong pair the frame is drawn into when drawing offscreen.
+static u32					g_scene_target = 0;
+static bool					g_scene_offscreen = false;
+static sf::RenderTarget*	g_target = &g_window; // Everything is drawn here: the window, or the current scene target.
 static f2				g_window_scaling = f2(1);
 static f2				g_window_borders = f2(0);
 
@@ -59,11 +416,25 @@ static double		g_total_time = 0;
 static double		g_frame_time = 0;
 static u64			g_frame_num = 0;
 
+// Asset packs (declared before anything loaded from them, so they're unmapped last)
+static const u32		MAX_ASSET_PACKS = 4;
+static MappedFile		g_asset_packs[MAX_ASSET_PACKS];
+static u32				g_total_asset_packs = 0;
+static std::unordered_map<u64, PackedAsset>	g_packed_assets;	// By path hash, for every mounted pack.
+
 // Fonts
 static const u16	MAX_FONTS = 10;
 static sf::Font		g_fonts[MAX_FONTS];
 static u32			g_total_fonts = 0;
 
+// Text layout cache (most recently used runs at the front)
+static std::list<TextRun>									g_text_runs;
+static std::unordered_map<u64, std::list<TextRun>::iterator>	g_text_run_lookup;
+static u32													g_text_cache_bytes = 0;
+static u32													g_text_cache_budget = 2 * 1024 * 1024;
+static u32													g_text_cache_hits = 0;
+static u32													g_text_cache_misses = 0;
+
 // Font styles
 static const int	MAX_FONT_STACK_SIZE = 10;
 static FontState	g_font_stack[MAX_FONT_STACK_SIZE];
@@ -72,32 +443,198 @@ static u32			g_font_stack_size = 0;
 // Textures
 static const u16		MAX_TEXTURES = 100;
 static sf::Texture		g_textures[MAX_TEXTURES];
+static const sf::Texture*	g_texture_sources[MAX_TEXTURES];	// Either the texture's own g_textures entry, or its atlas page.
+static sf::IntRect		g_texture_rects[MAX_TEXTURES];		// Region of the source texture the texture occupies.
 static sf::Texture		g_no_texture;
 static u32				g_total_textures = 0;
 
+// Texture atlases
+static const u16				MAX_ATLAS_PAGES = 8;
+static const u32				ATLAS_PAGE_SIZE = 2048;
+static const u32				ATLAS_MAX_TEXTURE_SIZE = 256;
+static const int				ATLAS_PADDING = 2;
+static sf::Texture				g_atlas_pages[MAX_ATLAS_PAGES];
+static std::vector<SkylineNode>	g_atlas_skylines[MAX_ATLAS_PAGES];
+static u32						g_total_atlas_pages = 0;
+static u64						g_atlas_used_texels = 0;
+static bool						g_texture_atlasing = false;
+
 // Sprites
 static const u16		MAX_SPRITES = 8192;
-static sf::Sprite		g_sprites[MAX_SPRITES];
-static u32				g_total_sprites;
+static const u32		SPRITE_INDEX_BITS = 16;
+static const u32		SPRITE_INDEX_MASK = (1 << SPRITE_INDEX_BITS) - 1;
+static const u16		NO_FREE_SPRITE = 0xFFFF;
+static TextureId		g_sprite_textures[MAX_SPRITES];
+static f2				g_sprite_positions[MAX_SPRITES];
+static float			g_sprite_rotations[MAX_SPRITES];
+static f2				g_sprite_scales[MAX_SPRITES];
+static f2				g_sprite_origins[MAX_SPRITES];	// Relative to the texture size, so it stays correct while the texture loads.
+static sf::Color		g_sprite_colours[MAX_SPRITES];
+static u16				g_sprite_generations[MAX_SPRITES];
+static u16				g_sprite_next_free[MAX_SPRITES];
+static u16				g_sprite_free_head = NO_FREE_SPRITE;
+static u32				g_total_sprites = 0; // High-water mark of slots handed out; slots below it are either live or on the free list.
+
+// Particles
+static const u16		MAX_EMITTERS = 64;
+static ParticleEmitter	g_emitters[MAX_EMITTERS];
 
 // Shaders
 static const u16		MAX_SHADERS = 10;
-static sf::Texture		g_postprocess_texture;
-static sf::Shader		g_shaders[MAX_SHADERS];
+static sf::Texture		g_postprocess_texture; // Only used when drawing straight to the window.
+static ShaderId			g_post_effect_chain[MAX_SHADERS];
+static u32				g_post_effect_chain_length = 0;
+static sf::Shader		g_shaders[MAX_SHADERS][2];	// The active program, and a spare that reloads compile into.
+static u8				g_shader_active[MAX_SHADERS] = { 0 };
+static u32				g_shader_downsample[MAX_SHADERS] = { 0 };	// Number of times the frame is halved before running the shader as a post effect.
+static std::string		g_shader_blur_inputs[MAX_SHADERS];			// Uniform to bind the blurred frame to, if any.
+static u32				g_shader_blur_levels[MAX_SHADERS] = { 0 };
 static u32				g_total_shaders = 0;
 
+// Shader hot reloading
+static const u32		SHADER_WATCH_INTERVAL_MS = 50;
+static const u32		SHADER_RELOAD_DELAY_MS = 100;	// Edits closer together than this are coalesced into one reload.
+static ShaderWatcher	g_shader_watcher;
+static bool				g_shader_hot_reload = false;
+
+// Shader uniforms
+static const u32		MAX_SHADER_UNIFORMS = 32;
+static const ShaderUniformId	NO_SHADER_UNIFORM = u32(-1);
+static UniformSlot		g_shader_uniforms[MAX_SHADERS][MAX_SHADER_UNIFORMS];
+static u32				g_shader_uniform_counts[MAX_SHADERS] = { 0 };
+
+// Reduced resolution post effect targets
+static const u32		MAX_DOWNSAMPLE_LEVELS = 5;
+static sf::RenderTexture	g_downsample_targets[MAX_DOWNSAMPLE_LEVELS][2];	// Per level, the downsampled frame and the shader output.
+static sf::RenderTexture	g_blur_targets[MAX_DOWNSAMPLE_LEVELS][2];		// Per level, the blurred frame and the blur scratch target.
+static sf::Shader		g_blur_shader;
+static bool				g_blur_shader_loaded = false;
+static const char*		BLUR_SHADER_SOURCE =
+	"uniform sampler2D texture;"
+	"uniform vec2 direction;"
+	"void main()"
+	"{"
+	"	vec2 uv = gl_TexCoord[0].xy;"
+	"	vec4 col = texture2D(texture, uv) * 0.2270270270;"
+	"	col += texture2D(texture, uv + direction * 1.3846153846) * 0.3162162162;"
+	"	col += texture2D(texture, uv - direction * 1.3846153846) * 0.3162162162;"
+	"	col += texture2D(texture, uv + direction * 3.2307692308) * 0.0702702703;"
+	"	col += texture2D(texture, uv - direction * 3.2307692308) * 0.0702702703;"
+	"	gl_FragColor = col;"
+	"}";
+
 // Audio
-static const u16		MAX_SOUNDS = 30;
-static sf::Sound		g_sounds[MAX_SOUNDS];
-static sf::SoundBuffer	g_sound_buffers[MAX_SOUNDS];
+static const u16		MAX_SOUNDS = 4096;
+static std::unique_ptr<sf::SoundBuffer>	g_sound_buffers[MAX_SOUNDS];	// Created as sounds are loaded, as each holds an OpenAL buffer.
+static bool				g_sound_pending[MAX_SOUNDS] = { false };
+static SoundBus			g_sound_buses[MAX_SOUNDS] = {};	// SFX by default.
+static u8				g_sound_priorities[MAX_SOUNDS] = { 0 };
+static u16				g_sound_voice_limits[MAX_SOUNDS] = { 0 };	// Zero for no limit.
+static u16				g_sound_voice_counts[MAX_SOUNDS] = { 0 };	// Voices currently playing each sound.
 static u32				g_total_sounds = 0;
 
+// Sound banks
+static const u32		MAX_SOUND_BANKS = 8;
+static MappedFile		g_sound_banks[MAX_SOUND_BANKS];
+static u32				g_total_sound_banks = 0;
+static const u8*		g_sound_bank_files[MAX_SOUNDS] = { nullptr };	// Where a bank sound's file is in its mapped bank.
+static u32				g_sound_bank_file_sizes[MAX_SOUNDS] = { 0 };
+static u32				g_sound_decoded_bytes[MAX_SOUNDS] = { 0 };
+
+// Decoded bank sounds (most recently played at the front)
+static std::list<SoundId>			g_decoded_bank_sounds;
+static std::list<SoundId>::iterator	g_decoded_bank_sound_entries[MAX_SOUNDS];
+static u32							g_decoded_bank_bytes = 0;
+static u32							g_sound_bank_budget = 16 * 1024 * 1024;
+
+// Music
+static const u16		MAX_MUSIC = 8;
+static const MusicId	NO_MUSIC = 0xFFFF;
+static MusicStream		g_music[MAX_MUSIC];
+static float			g_music_volumes[MAX_MUSIC] = { 0 };
+static float			g_music_fades[MAX_MUSIC] = { 0 };		// Fade level, from 0 (silent) to 1.
+static float			g_music_fade_rates[MAX_MUSIC] = { 0 };	// Change in fade level per second.
+static u32				g_total_music = 0;
+static MusicId			g_current_music = NO_MUSIC;
+
+// Sound voices
+static const u32		MAX_VOICES = 256;	// OpenAL implementations tend to run out of sources beyond this.
+static const u32		VOICE_INDEX_BITS = 16;
+static const u32		VOICE_INDEX_MASK = (1 << VOICE_INDEX_BITS) - 1;
+static const u16		NO_FREE_VOICE = 0xFFFF;
+static const SoundId	NO_SOUND = 0xFFFF;
+static std::vector<sf::Sound>	g_voices;	// Created on first use, as each one holds an OpenAL source.
+static u32				g_voice_count = 32;
+static SoundId			g_voice_sounds[MAX_VOICES];			// NO_SOUND while the voice is free.
+static float			g_voice_volumes[MAX_VOICES];
+static u64				g_voice_play_orders[MAX_VOICES];	// When the voice started playing, for finding the oldest.
+static u16				g_voice_generations[MAX_VOICES];
+static u16				g_voice_next_free[MAX_VOICES];
+static SoundBus			g_voice_buses[MAX_VOICES];
+static float			g_voice_pans[MAX_VOICES];
+static u16				g_voice_free_head = NO_FREE_VOICE;
+static u64				g_voices_played = 0;
+static bool				g_voices_ready = false;
+
+// Software mixed voices (guarded by g_mixer_mutex, as they're mixed on the streaming thread)
+static double			g_voice_positions[MAX_VOICES];	// In frames of the voice's sound.
+static double			g_voice_steps[MAX_VOICES];		// Frames of the sound per mixed frame, from its sample rate and pitch.
+static float			g_voice_gains[MAX_VOICES][2];	// Left and right.
+static bool				g_voice_loops[MAX_VOICES];
+static bool				g_voice_finished[MAX_VOICES];
+
+// Mixer
+static SoundMixer		g_sound_mixer = SoundMixer::OpenAL;
+static std::mutex		g_mixer_mutex;
+static MixerStream		g_mixer_stream;	// Only plays with the software mixer.
+
+// Mixer buses
+static const u32		BUS_COUNT = u32(SoundBus::COUNT);
+static float			g_bus_volumes[BUS_COUNT] = { 1, 1, 1, 1 };
+static float			g_bus_target_volumes[BUS_COUNT] = { 1, 1, 1, 1 };
+static float			g_bus_fade_rates[BUS_COUNT] = { 0 };	// Volume change per second, towards the target.
+static float			g_bus_gains[BUS_COUNT] = { 1, 1, 1, 1 };	// Volumes including the master bus's, as applied to voices.
+
+// Async loading
+static const u32		MAX_LOADER_THREADS = 4;
+static AsyncLoader		g_async_loader;
+static u32				g_pending_loads = 0;
+static float			g_async_upload_budget = 0.002f;
+
 // Random
 static u64				g_random_seeds[2];
 
 // Screenshake
 static float			g_screenshake_amount = 0;
 
+// Frame capture
+static u64				g_capture_frame = 0;
+static std::string		g_capture_path;
+
+// Batching
+static sf::VertexArray		g_batch_vertices(sf::Triangles);
+static const sf::Texture*	g_batch_texture = nullptr;
+static bool					g_batching_enabled = true;
+static u32					g_batch_submissions = 0;
+static u32					g_batch_draw_calls = 0;
+
+// Circles
+static const u32			CIRCLE_LODS = 5;	// Unit circles of 8, 16, 32, 64 and 128 segments.
+static const u32			MIN_CIRCLE_SEGMENTS = 8;
+static std::vector<f2>		g_unit_circles[CIRCLE_LODS];
+static float				g_circle_tolerance = 0.5f;	// Max distance in pixels between a circle and its tessellation.
+
+// Render stats
+static const u32			RENDER_STATS_HISTORY = 60;
+static RenderStats			g_render_stats = {};
+static RenderStats			g_render_stats_history[RENDER_STATS_HISTORY] = {};
+static u32					g_render_stats_frames = 0;
+static const sf::Texture*	g_last_bound_texture = nullptr;
+
+// Sprite layers
+static std::vector<LayerSprite>	g_sprite_layer;
+static bool						g_sprite_layer_active = false;
+
 //////////////////////////////////////////////////////////////////////////
 // Forward declarations as necessary.
 //////////////////////////////////////////////////////////////////////////
@@ -105,6 +642,16 @@ static float			g_screenshake_amount = 0;
 static void SetNormalisedClipRegion(f2 top_left_px, f2 size_px);
 static bool RecreateWindow();
 static void UpdateWindowIcon();
+static void FlushBatch();
+static bool InitTextureFromImage(TextureId id, const sf::Image& image);
+static void ProcessAsyncLoads();
+static void ProcessShaderReloads();
+static void UpdateParticles(float dt);
+static void RefreshVoices();
+static void UpdateMusic(float dt);
+static void UpdateMixer(float dt);
+static void PresentFrame();
+static bool ReadFileContents(const std::string& path, std::string& contents);
 
 //////////////////////////////////////////////////////////////////////////
 // Internal API
@@ -114,141 +661,567 @@ sf::Color Col(f4 c) { return sf::Color(u8(c.x * 255), u8(c.y * 255), u8(c.z * 25
 f2 ScreenSize() { return f2(float(g_window_width), float(g_window_height)); }
 
 //////////////////////////////////////////////////////////////////////////
-// Game API
+// Render stats
 //////////////////////////////////////////////////////////////////////////
 
-void CoreInit()
+// Records a draw call in the current frame's stats. Like SFML, only counts a texture bind when the texture changes.
+static void CountDrawCall(u32 vertex_count, const sf::Texture* texture, const sf::Shader* shader)
 {
-	g_core_initialised = true;
+	++g_render_stats.draw_calls;
+	g_render_stats.vertices += vertex_count;
+	if(texture != g_last_bound_texture)
+	{
+		++g_render_stats.texture_binds;
+		g_last_bound_texture = texture;
+	}
+	if(shader)
+		++g_render_stats.shader_binds;
+}
 
-	// Open the window.
-	RecreateWindow();
+// Moves the current frame's stats into the history.
+static void EndRenderStatsFrame()
+{
+	g_render_stats.draw_calls_saved = g_batch_submissions - g_batch_draw_calls;
+	g_batch_submissions = 0;
+	g_batch_draw_calls = 0;
 
-	// Initialise random number generator.
-	g_random_seeds[0] = 0;
-	g_random_seeds[1] = 1;
-	srand((unsigned int)time(NULL));
-	for (int i = 0; i < 10; ++i)
-		rand();
-	for (int i = 0; i < 2; ++i)
-		for (int j = 0; j < 64; ++j)
-			g_random_seeds[i] |= (rand() % 2) << j;
+	g_render_stats_history[g_render_stats_frames % RENDER_STATS_HISTORY] = g_render_stats;
+	++g_render_stats_frames;
+	g_render_stats = RenderStats();
+}
 
-	// Initialise postprocessing texture buffer.
-	g_postprocess_texture.create(g_window_width, g_window_height);
+//////////////////////////////////////////////////////////////////////////
+// Batching
+//////////////////////////////////////////////////////////////////////////
 
-	// Initialise default font.
-	g_font_stack[0].size = 24;
-	g_font_stack[0].col = f4(1);
-	g_font_stack[0].scale = 1;
-	g_font_stack[0].font = 0;
+// Submits the pending batch vertices in a single draw call.
+static void FlushBatchVertices()
+{
+	if(g_batch_vertices.getVertexCount() == 0)
+		return;
 
-	// Set up the gamepad library.
-	#if INCLUDE_GAMEPAD_LIBRARY
-	GamepadInit();
-	#endif
+	PROFILE_SCOPE("FlushBatch");
+	g_target->draw(g_batch_vertices, sf::RenderStates(g_batch_texture));
+	CountDrawCall(u32(g_batch_vertices.getVertexCount()), g_batch_texture, nullptr);
+	g_batch_vertices.clear();
+	++g_batch_draw_calls;
 }
 
-bool StartFrame()
+// Switches the texture used by the batch, flushing anything drawn with the previous texture.
+static void SetBatchTexture(const sf::Texture* texture)
 {
-	//------------------------------------------------------------------------
-	// End of the existing frame.
-	//------------------------------------------------------------------------
-	// Draw the window contents.
-	g_window.display();
+	if(texture != g_batch_texture)
+	{
+		FlushBatchVertices();
+		g_batch_texture = texture;
+	}
+}
 
-	// Reset clipping and coordinate regions.
-	SetNormalisedClipRegion(f2(0), f2(1));
-	SetWindowWorldRegion(f2(0), ScreenSize());
+// Appends a quad (corners in winding order) to the batch vertices.
+static void AppendQuad(const sf::Vertex* quad, const sf::Texture* texture)
+{
+	SetBatchTexture(texture);
 
-	//------------------------------------------------------------------------
-	// Start of the new frame.
-	//------------------------------------------------------------------------
-	// Update timings.
-	g_total_time = g_clock.getElapsedTime().asMicroseconds() / (1000.0 * 1000.0);
-	g_frame_time = g_frameclock.restart().asMicroseconds() / (1000.0 * 1000.0);
-	g_frame_time = min(g_frame_time, 1.0 / 15.0);
-	++g_frame_num;
-	
-	// Update gamepad input.
-	#if INCLUDE_GAMEPAD_LIBRARY
-	GamepadStartFrame();
-	#endif
+	g_batch_vertices.append(quad[0]);
+	g_batch_vertices.append(quad[1]);
+	g_batch_vertices.append(quad[2]);
+	g_batch_vertices.append(quad[0]);
+	g_batch_vertices.append(quad[2]);
+	g_batch_vertices.append(quad[3]);
+	++g_batch_submissions;
 
-	// Reset input state.
-	for (int i = 0; i < Key::KeyCount; ++i)
+	if(!g_batching_enabled)
+		FlushBatchVertices();
+}
+
+// Moves any sprites recorded in the current sprite layer into the batch, grouped by texture.
+static void FlushSpriteLayer()
+{
+	if(g_sprite_layer.empty())
+		return;
+
+	std::stable_sort(g_sprite_layer.begin(), g_sprite_layer.end(),
+		[](const LayerSprite& a, const LayerSprite& b) { return a.texture < b.texture; });
+
+	for(const LayerSprite& s : g_sprite_layer)
+		AppendQuad(s.quad, s.texture);
+	g_sprite_layer.clear();
+}
+
+// Submits all pending batched geometry.
+static void FlushBatch()
+{
+	FlushSpriteLayer();
+	FlushBatchVertices();
+}
+
+// Batches a quad in submission order.
+static void BatchQuad(const sf::Vertex* quad, const sf::Texture* texture)
+{
+	FlushSpriteLayer();
+	AppendQuad(quad, texture);
+}
+
+// Batches a sprite quad, deferring it for texture sorting if a sprite layer is active.
+static void BatchSprite(const sf::Vertex* quad, const sf::Texture* texture)
+{
+	if(!g_sprite_layer_active)
 	{
-		g_key_click[i] = false;
-		g_key_unclick[i] = false;
+		BatchQuad(quad, texture);
+		return;
 	}
-	for (int i = 0; i < 2; ++i)
+
+	LayerSprite s;
+	s.texture = texture;
+	for(int i = 0; i < 4; ++i)
+		s.quad[i] = quad[i];
+	g_sprite_layer.push_back(s);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Asset packs
+//////////////////////////////////////////////////////////////////////////
+
+// Packed paths use forward slashes, with no leading "./", so "./a\\b.png" finds "a/b.png".
+static void NormaliseAssetPath(const char* path, std::string& normalised)
+{
+	while(path[0] == '.' && (path[1] == '/' || path[1] == '\\'))
+		path += 2;
+	normalised = path;
+	std::replace(normalised.begin(), normalised.end(), '\\', '/');
+}
+
+static u64 HashAssetPath(const std::string& path)
+{
+	// FNV-1a
+	u64 hash = 14695981039346656037ull;
+	for(char c : path)
+		hash = (hash ^ u8(c)) * 1099511628211ull;
+	return hash;
+}
+
+// Finds an asset's file in the mounted packs, pointing straight at its mapped pages.
+static bool FindPackedAsset(const char* path, const u8*& data, u32& size)
+{
+	if(g_packed_assets.empty())
+		return false;
+
+	std::string normalised;
+	NormaliseAssetPath(path, normalised);
+	auto it = g_packed_assets.find(HashAssetPath(normalised));
+	if(it == g_packed_assets.end() || normalised.compare(0, std::string::npos, it->second.path, it->second.path_size) != 0)
+		return false;
+
+	data = it->second.data;
+	size = it->second.size;
+	return true;
+}
+
+bool MountAssetPack(const char* path)
+{
+	if(g_total_asset_packs >= MAX_ASSET_PACKS)
 	{
-		g_mouse_click[i] = false;
-		g_mouse_unclick[i] = false;
+		printf("[ERR]: No remaining asset pack memory!\n");
+		return false;
 	}
 
-	// Event processing loop.
-	sf::Event event;
-	while(g_window.pollEvent(event))
+	MappedFile& pack = g_asset_packs[g_total_asset_packs];
+	if(!pack.open(path))
+	{
+		printf("[ERR]: Couldn't open asset pack %s\n", path);
+		return false;
+	}
+
+	// Check the header and index up front, so lookups can trust them.
+	AssetPackHeader header = {};
+	if(pack.size >= sizeof(header))
+		memcpy(&header, pack.data, sizeof(header));
+	u64 index_end = sizeof(header) + u64(header.asset_count) * sizeof(AssetPackEntry);
+	bool valid = header.magic == ASSET_PACK_MAGIC && header.version == ASSET_PACK_VERSION && index_end <= pack.size;
+	for(u32 i = 0; valid && i < header.asset_count; ++i)
+	{
+		AssetPackEntry entry;
+		memcpy(&entry, pack.data + sizeof(header) + i * sizeof(entry), sizeof(entry));
+		valid = u64(entry.path_offset) + entry.path_size <= pack.size && u64(entry.offset) + entry.size <= pack.size;
+	}
+	if(!valid)
+	{
+		printf("[ERR]: %s isn't a valid asset pack\n", path);
+		pack.close();
+		return false;
+	}
+
+	// Assets in later packs replace those with the same path in earlier ones.
+	for(u32 i = 0; i < header.asset_count; ++i)
+	{
+		AssetPackEntry entry;
+		memcpy(&entry, pack.data + sizeof(header) + i * sizeof(entry), sizeof(entry));
+		PackedAsset asset = { (const char*)pack.data + entry.path_offset, entry.path_size, pack.data + entry.offset, entry.size };
+		auto inserted = g_packed_assets.insert(std::make_pair(entry.path_hash, asset));
+		if(!inserted.second)
+		{
+			PackedAsset& existing = inserted.first->second;
+			if(existing.path_size == asset.path_size && memcmp(existing.path, asset.path, asset.path_size) == 0)
+				existing = asset;
+			else
+				printf("[ERR]: %.*s in asset pack %s has the same hash as %.*s, so can't be found\n",
+					int(asset.path_size), asset.path, path, int(existing.path_size), existing.path);
+		}
+	}
+	++g_total_asset_packs;
+	return true;
+}
+
+bool BuildAssetPack(const char* pack_path, const char* const* asset_paths, u32 count)
+{
+	std::vector<std::string> paths(count);
+	std::vector<std::string> files(count);
+	std::vector<AssetPackEntry> entries(count);
+	std::unordered_map<u64, u32> hashes;
+	u64 offset = sizeof(AssetPackHeader) + u64(count) * sizeof(AssetPackEntry);
+	for(u32 i = 0; i < count; ++i)
 	{
-		if (event.type == sf::Event::Closed)
+		NormaliseAssetPath(asset_paths[i], paths[i]);
+		entries[i].path_hash = HashAssetPath(paths[i]);
+		entries[i].path_offset = u32(offset);
+		entries[i].path_size = u32(paths[i].size());
+		offset += paths[i].size();
+
+		auto inserted = hashes.insert(std::make_pair(entries[i].path_hash, i));
+		if(!inserted.second)
 		{
+			printf("[ERR]: %s is packed twice, or has the same hash as %s\n", asset_paths[i], asset_paths[inserted.first->second]);
 			return false;
 		}
-		else if (event.type == sf::Event::KeyPressed)
+	}
+	for(u32 i = 0; i < count; ++i)
+	{
+		if(!ReadFileContents(asset_paths[i], files[i]))
 		{
-			if(event.key.code == Key::Unknown)
-			{
-				continue;
-			}
-			if (!g_key_down[event.key.code])
-			{
-				g_key_click[event.key.code] = true;
-				g_key_down[event.key.code] = true;
-			}
+			printf("[ERR]: Couldn't read asset file %s\n", asset_paths[i]);
+			return false;
+		}
+
+		entries[i].offset = u32(offset);
+		entries[i].size = u32(files[i].size());
+		offset += files[i].size();
+	}
+	if(offset > u32(-1))
+	{
+		printf("[ERR]: Asset pack %s would be over 4GB!\n", pack_path);
+		return false;
+	}
+
+	FILE* pack = fopen(pack_path, "wb");
+	if(!pack)
+	{
+		printf("[ERR]: Couldn't write asset pack %s\n", pack_path);
+		return false;
+	}
+
+	AssetPackHeader header = { ASSET_PACK_MAGIC, ASSET_PACK_VERSION, count };
+	bool success = fwrite(&header, sizeof(header), 1, pack) == 1;
+	if(count > 0)
+		success = success && fwrite(&entries[0], sizeof(AssetPackEntry), count, pack) == count;
+	for(const std::string& path : paths)
+		success = success && fwrite(path.data(), 1, path.size(), pack) == path.size();
+	for(const std::string& file : files)
+		success = success && fwrite(file.data(), 1, file.size(), pack) == file.size();
+	success = fclose(pack) == 0 && success;
+	if(!success)
+		printf("[ERR]: Couldn't write asset pack %s\n", pack_path);
+	return success;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Async loading
+//////////////////////////////////////////////////////////////////////////
+
+static void AsyncLoaderWorker()
+{
+	for(;;)
+	{
+		AsyncLoad* load;
+		{
+			std::unique_lock<std::mutex> lock(g_async_loader.mutex);
+			g_async_loader.wake.wait(lock, [] { return g_async_loader.quitting || !g_async_loader.requests.empty(); });
+			if(g_async_loader.quitting)
+				return;
+			load = g_async_loader.requests.front();
+			g_async_loader.requests.pop_front();
 		}
-		else if(event.type == sf::Event::KeyReleased)
+
+		// Decoding doesn't touch OpenGL or OpenAL, so it is safe to do off the main thread.
+		if(load->type == AsyncLoadType::Texture)
+		{
+			load->success = load->packed_data ? load->image.loadFromMemory(load->packed_data, load->packed_size)
+											  : load->image.loadFromFile(load->path);
+		}
+		else
 		{
-			if(event.key.code == Key::Unknown)
+			sf::InputSoundFile file;
+			load->success = load->packed_data ? file.openFromMemory(load->packed_data, load->packed_size)
+											  : file.openFromFile(load->path);
+			if(load->success)
 			{
-				continue;
+				load->channel_count = file.getChannelCount();
+				load->sample_rate = file.getSampleRate();
+				load->samples.resize(std::size_t(file.getSampleCount()));
+				load->success = load->samples.empty() || file.read(&load->samples[0], load->samples.size()) == load->samples.size();
 			}
-			g_key_down[event.key.code] = false;
-			g_key_unclick[event.key.code] = true;
 		}
-		else if(event.type == sf::Event::MouseButtonPressed)
+
+		std::lock_guard<std::mutex> lock(g_async_loader.mutex);
+		g_async_loader.results.push_back(load);
+	}
+}
+
+static void QueueAsyncLoad(AsyncLoadType type, u16 id, const char* path)
+{
+	// Start the workers the first time they're needed.
+	if(g_async_loader.workers.empty())
+	{
+		u32 thread_count = clamp(std::thread::hardware_concurrency(), 2u, MAX_LOADER_THREADS + 1) - 1;
+		for(u32 i = 0; i < thread_count; ++i)
+			g_async_loader.workers.push_back(std::thread(AsyncLoaderWorker));
+	}
+
+	AsyncLoad* load = new AsyncLoad();
+	load->type = type;
+	load->id = id;
+	load->path = path;
+	load->packed_data = nullptr;
+	load->packed_size = 0;
+	FindPackedAsset(path, load->packed_data, load->packed_size);	// Looked up here, as only the main thread mounts packs.
+	load->success = false;
+	++g_pending_loads;
+	{
+		std::lock_guard<std::mutex> lock(g_async_loader.mutex);
+		g_async_loader.requests.push_back(load);
+	}
+	g_async_loader.wake.notify_one();
+}
+
+// Uploads finished loads to the GPU/audio device, stopping once the frame's upload budget is used.
+static void ProcessAsyncLoads()
+{
+	if(g_pending_loads == 0)
+		return;
+
+	sf::Clock timer;
+	do
+	{
+		AsyncLoad* load;
+		{
+			std::lock_guard<std::mutex> lock(g_async_loader.mutex);
+			if(g_async_loader.results.empty())
+				return;
+			load = g_async_loader.results.front();
+			g_async_loader.results.pop_front();
+		}
+
+		if(load->type == AsyncLoadType::Texture)
 		{
-			if (event.mouseButton.button == sf::Mouse::Left)
-				g_mouse_click[0] = true;
-			else if (event.mouseButton.button == sf::Mouse::Right)
-				g_mouse_click[1] = true;
+			if(!load->success || !InitTextureFromImage(load->id, load->image))
+				printf("[ERR]: Couldn't load texture file from %s\n", load->path.c_str());
 		}
-		else if(event.type == sf::Event::MouseButtonReleased)
+		else
 		{
-			if (event.mouseButton.button == sf::Mouse::Left)
-				g_mouse_unclick[0] = true;
-			else if (event.mouseButton.button == sf::Mouse::Right)
-				g_mouse_unclick[1] = true;
+			if(!load->success || !g_sound_buffers[load->id]->loadFromSamples(load->samples.empty() ? nullptr : &load->samples[0], load->samples.size(), load->channel_count, load->sample_rate))
+				printf("[ERR]: Couldn't load sound file from %s\n", load->path.c_str());
+			g_sound_pending[load->id] = false;
 		}
-		else if(event.type == sf::Event::MouseMoved)
+
+		--g_pending_loads;
+		delete load;
+	}
+	while(timer.getElapsedTime().asSeconds() < g_async_upload_budget);
+}
+
+u32 GetPendingLoadCount()
+{
+	return g_pending_loads;
+}
+
+void SetAsyncUploadBudget(float seconds)
+{
+	g_async_upload_budget = seconds;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Game API
+//////////////////////////////////////////////////////////////////////////
+
+void CoreInit()
+{
+	g_core_initialised = true;
+
+	// Open the window.
+	RecreateWindow();
+
+	// Initialise random number generator.
+	g_random_seeds[0] = 0;
+	g_random_seeds[1] = 1;
+	srand((unsigned int)time(NULL));
+	for (int i = 0; i < 10; ++i)
+		rand();
+	for (int i = 0; i < 2; ++i)
+		for (int j = 0; j < 64; ++j)
+			g_random_seeds[i] |= (rand() % 2) << j;
+
+	// Initialise the placeholder drawn for textures that are still loading.
+	sf::Image no_texture_image;
+	no_texture_image.create(1, 1, sf::Color::White);
+	g_no_texture.loadFromImage(no_texture_image);
+
+	// Initialise default font.
+	g_font_stack[0].size = 24;
+	g_font_stack[0].col = f4(1);
+	g_font_stack[0].scale = 1;
+	g_font_stack[0].font = 0;
+
+	// Set up the gamepad library.
+	#if INCLUDE_GAMEPAD_LIBRARY
+	GamepadInit();
+	#endif
+}
+
+bool StartFrame()
+{
+	//------------------------------------------------------------------------
+	// End of the existing frame.
+	//------------------------------------------------------------------------
+	// Draw the window contents.
+	{
+		PROFILE_SCOPE("Display");
+		PresentFrame();
+	}
+
+	#if INCLUDE_PROFILER
+	ProfilerStartFrame();
+	#endif
+
+	// Reset the render stats for the new frame.
+	EndRenderStatsFrame();
+
+	// Reset clipping and coordinate regions.
+	SetNormalisedClipRegion(f2(0), f2(1));
+	SetWindowWorldRegion(f2(0), ScreenSize());
+
+	//------------------------------------------------------------------------
+	// Start of the new frame.
+	//------------------------------------------------------------------------
+	// Update timings.
+	g_total_time = g_clock.getElapsedTime().asMicroseconds() / (1000.0 * 1000.0);
+	g_frame_time = g_frameclock.restart().asMicroseconds() / (1000.0 * 1000.0);
+	g_frame_time = min(g_frame_time, 1.0 / 15.0);
+	++g_frame_num;
+	
+	// Upload any assets that finished loading in the background.
+	ProcessAsyncLoads();
+
+	// Swap in any shaders that were edited.
+	ProcessShaderReloads();
+
+	// Apply bus volume changes, free up the voices of sounds that have finished, and fade music in and out.
+	UpdateMixer(float(g_frame_time));
+	RefreshVoices();
+	UpdateMusic(float(g_frame_time));
+
+	// Spawn, move and age particles.
+	UpdateParticles(float(g_frame_time));
+
+	// Update gamepad input.
+	#if INCLUDE_GAMEPAD_LIBRARY
+	GamepadStartFrame();
+	#endif
+
+	// Reset input state.
+	for (int i = 0; i < Key::KeyCount; ++i)
+	{
+		g_key_click[i] = false;
+		g_key_unclick[i] = false;
+	}
+	for (int i = 0; i < 2; ++i)
+	{
+		g_mouse_click[i] = false;
+		g_mouse_unclick[i] = false;
+	}
+
+	// Event processing loop.
+	{
+		PROFILE_SCOPE("EventLoop");
+		sf::Event event;
+		while(!g_window_headless && g_window.pollEvent(event))
 		{
-			g_mouse_pos[0] = event.mouseMove.x;
-			g_mouse_pos[1] = event.mouseMove.y;
+			if (event.type == sf::Event::Closed)
+			{
+				return false;
+			}
+			else if (event.type == sf::Event::KeyPressed)
+			{
+				if(event.key.code == Key::Unknown)
+				{
+					continue;
+				}
+				if (!g_key_down[event.key.code])
+				{
+					g_key_click[event.key.code] = true;
+					g_key_down[event.key.code] = true;
+				}
+			}
+			else if(event.type == sf::Event::KeyReleased)
+			{
+				if(event.key.code == Key::Unknown)
+				{
+					continue;
+				}
+				g_key_down[event.key.code] = false;
+				g_key_unclick[event.key.code] = true;
+			}
+			else if(event.type == sf::Event::MouseButtonPressed)
+			{
+				if (event.mouseButton.button == sf::Mouse::Left)
+					g_mouse_click[0] = true;
+				else if (event.mouseButton.button == sf::Mouse::Right)
+					g_mouse_click[1] = true;
+			}
+			else if(event.type == sf::Event::MouseButtonReleased)
+			{
+				if (event.mouseButton.button == sf::Mouse::Left)
+					g_mouse_unclick[0] = true;
+				else if (event.mouseButton.button == sf::Mouse::Right)
+					g_mouse_unclick[1] = true;
+			}
+			else if(event.type == sf::Event::MouseMoved)
+			{
+				g_mouse_pos[0] = event.mouseMove.x;
+				g_mouse_pos[1] = event.mouseMove.y;
+			}
 		}
 	}
 
+	// Step the physics world, now this frame's input has been processed.
+	#if INCLUDE_PHYSICS
+	PhysicsStartFrame(float(g_frame_time));
+	#endif
+
 	// Update screenshake
-	sf::Vector2f cam_center	= g_window.getView().getCenter();
-	f2 shake				= f2((float)RandNorm() * 2 - 1, (float)RandNorm() * 2 - 1) * g_screenshake_amount * 20;
-	f2 actual_center		= f2((float)g_window_width, (float)g_window_height) * 0.5f;
-	f2 target_center		= actual_center + shake;
-	target_center			= lerp(f2(cam_center.x, cam_center.y), target_center, (float)GetFrameTime() * 20);
-
-	// Apply screenshake
-	sf::View v = g_window.getView();
-	v.setCenter(sf::Vector2f(target_center.x, target_center.y));
-	g_window.setView(v);
-	g_screenshake_amount = max(g_screenshake_amount - (float)GetFrameTime(), 0.0f);
+	{
+		PROFILE_SCOPE("ScreenShake");
+		sf::Vector2f cam_center	= g_target->getView().getCenter();
+		f2 shake				= f2((float)RandNorm() * 2 - 1, (float)RandNorm() * 2 - 1) * g_screenshake_amount * 20;
+		f2 actual_center		= f2((float)g_window_width, (float)g_window_height) * 0.5f;
+		f2 target_center		= actual_center + shake;
+		target_center			= lerp(f2(cam_center.x, cam_center.y), target_center, (float)GetFrameTime() * 20);
+
+		// Apply screenshake
+		FlushBatch();
+		sf::View v = g_target->getView();
+		v.setCenter(sf::Vector2f(target_center.x, target_center.y));
+		g_target->setView(v);
+		g_screenshake_amount = max(g_screenshake_amount - (float)GetFrameTime(), 0.0f);
+	}
 
 	// Default key bindings.
 	{
@@ -262,7 +1235,10 @@ bool StartFrame()
 	}
 
 	// Clear the window.
-	g_window.clear(Col(g_window_clear_col));
+	{
+		PROFILE_SCOPE("Clear");
+		g_target->clear(Col(g_window_clear_col));
+	}
 
 	// Do black borders if we're in a imperfect fullscreen ratio.
 	if(g_window_fullscreen)
@@ -283,7 +1259,7 @@ bool StartFrame()
 		SetNormalisedClipRegion(g_window_borders / ScreenSize(), f2(scaling));
 	}
 
-	return g_window.isOpen();
+	return g_window_headless || g_window.isOpen();
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -293,7 +1269,11 @@ bool StartFrame()
 static void UpdateWindowIcon()
 {
 	sf::Image iconimg;
-	if(!iconimg.loadFromFile(g_window_icon_path))
+	const u8* data;
+	u32 size;
+	bool loaded = FindPackedAsset(g_window_icon_path, data, size) ? iconimg.loadFromMemory(data, size)
+																	: iconimg.loadFromFile(g_window_icon_path);
+	if(!loaded)
 	{
 		printf("[ERR]: Couldn't load window icon from: %s\n", g_window_icon_path);
 		return;
@@ -301,11 +1281,35 @@ static void UpdateWindowIcon()
 	g_window.setIcon(iconimg.getSize().x, iconimg.getSize().y, iconimg.getPixelsPtr());
 }
 
+static bool CreateSceneTargets(u32 width, u32 height)
+{
+	g_scene_offscreen = g_scene_targets[0].create(width, height) && g_scene_targets[1].create(width, height);
+	g_scene_targets[0].setSmooth(true);
+	g_scene_targets[1].setSmooth(true);
+	g_scene_target = 0;
+	g_target = g_scene_offscreen ? (sf::RenderTarget*)&g_scene_targets[0] : &g_window;
+	return g_scene_offscreen;
+}
+
 static bool RecreateWindow()
 {
 	if(!g_core_initialised)
 		return false;
 
+	// Headless mode renders offscreen at the window size, with no frame limiting.
+	if(g_window_headless)
+	{
+		FlushBatch();
+		if(g_window.isOpen())
+			g_window.close();
+		if(!CreateSceneTargets(g_window_width, g_window_height))
+		{
+			printf("[ERR]: Couldn't create the headless render target!\n");
+			return false;
+		}
+		return true;
+	}
+
 	sf::VideoMode video_mode(g_window_width, g_window_height);
 	if(g_window_fullscreen && !video_mode.isValid())
 	{
@@ -339,6 +1343,8 @@ static bool RecreateWindow()
 	sf::ContextSettings settings;
 	settings.antialiasingLevel = g_window_antialiased ? 8 : 0;
 
+	FlushBatch();
+	g_target = &g_window;
 	g_window.create(video_mode, g_window_title, windowstyle, settings);
 	g_window.setFramerateLimit(g_window_fps);
 	g_window.setMouseCursorVisible(g_window_mouse_visible);
@@ -346,14 +1352,27 @@ static bool RecreateWindow()
 	if(g_window_icon_path[0]!=0)
 		UpdateWindowIcon();
 
+	// Draw the frame offscreen, so post effects can ping-pong between targets rather than copying the backbuffer.
+	// SFML's render textures can't be antialiased though, so antialiased windows are drawn to directly.
+	sf::Vector2u size = g_window.getSize();
+	if(g_window_antialiased || !CreateSceneTargets(size.x, size.y))
+	{
+		// Forget any scene targets from before, so stale frames aren't presented over the window.
+		g_scene_offscreen = false;
+		g_scene_target = 0;
+		g_target = &g_window;
+		g_postprocess_texture.create(size.x, size.y);
+	}
+
 	return true;
 }
 
 static void SetNormalisedClipRegion(f2 top_left, f2 size)
 {
-	sf::View curr_view = g_window.getView();
+	FlushBatch();
+	sf::View curr_view = g_target->getView();
 	curr_view.setViewport(sf::FloatRect(top_left.x, top_left.y, size.x, size.y));
-	g_window.setView(curr_view);
+	g_target->setView(curr_view);
 }
 
 void SetWindowTitle(const char* title)
@@ -420,6 +1439,21 @@ void SetWindowAntialiased(bool b)
 	}
 }
 
+void SetWindowHeadless(bool b)
+{
+	if(g_window_headless != b)
+	{
+		g_window_headless = b;
+		RecreateWindow();
+	}
+}
+
+void SaveFrameToFile(u64 frame, const char* path)
+{
+	g_capture_frame = frame;
+	g_capture_path = path;
+}
+
 void SetWindowSize(int x, int y)
 {
 	if(g_window_width != x || g_window_height != y)
@@ -456,10 +1490,11 @@ void SetWindowClipRegion(f2 top_left_px, f2 size_px)
 
 void SetWindowWorldRegion(f2 top_left_world, f2 size_world)
 {
-	sf::View view = g_window.getView();
+	FlushBatch();
+	sf::View view = g_target->getView();
 	view.setCenter(top_left_world.x + size_world.x * 0.5f, top_left_world.y + size_world.y * 0.5f);
 	view.setSize(size_world.x, size_world.y);
-	g_window.setView(view);
+	g_target->setView(view);
 }
 
 void ResetWindowClipRegion()
@@ -557,463 +1592,2455 @@ u64 GetFrameNumber()
 
 FontId LoadFont(const char* path)
 {
-	if (g_total_fonts < MAX_FONTS)
+	if (g_total_fonts < MAX_FONTS)
+	{
+		// Fonts read from their data as glyphs are needed, which is fine for packed fonts as packs stay mapped.
+		const u8* data;
+		u32 size;
+		if (FindPackedAsset(path, data, size) ? g_fonts[g_total_fonts].loadFromMemory(data, size)
+											  : g_fonts[g_total_fonts].loadFromFile(path))
+		{
+			return g_total_fonts++;
+		}
+
+		printf("[ERR]: Could not load font from %s\n", path);
+		return -1;
+	}
+
+	printf("[ERR]: Out of font memory!\n");
+	return -1;
+}
+
+void PushFontStyle()
+{
+	if(g_font_stack_size == MAX_FONT_STACK_SIZE - 1)
+	{
+		printf("[ERR]: Font style stack is too big to push onto. Did you forget to pop?\n");
+		return;
+	}
+
+	u32 copy_from = g_font_stack_size;
+	g_font_stack_size += 1;
+	g_font_stack[g_font_stack_size] = g_font_stack[copy_from];
+}
+
+void PopFontStyle()
+{
+	if(g_font_stack_size == 0)
+	{
+		printf("[ERR]: Font style stack is already empty.\n");
+		return;
+	}
+
+	g_font_stack_size -= 1;
+}
+
+static FontState& GetFontState()
+{
+	return g_font_stack[g_font_stack_size];
+}
+
+void SetFont(FontId font)
+{
+	if (font < g_total_fonts)
+	{
+		GetFontState().font = font;
+	}
+}
+
+void SetFontSize(u32 size)
+{
+	GetFontState().size = size;
+}
+
+void SetFontColour(f4 col)
+{
+	GetFontState().col = col;
+}
+
+void SetFontScale(float scale)
+{
+	GetFontState().scale = scale;
+}
+
+void DrawText(const char* text, f2 pos, TextAlign align)
+{
+	FontState& font_state = GetFontState();
+	DrawText(text, font_state.font, pos, font_state.size, font_state.col, align, font_state.scale);
+}
+
+// Lays out a string the same way sf::Text does, with the origin (alignment) and scale baked in.
+static void LayoutTextRun(const char* text, const sf::Font& font, u32 size_px, TextAlign align, float scale, std::vector<sf::Vertex>& vertices)
+{
+	vertices.clear();
+	sf::String str(text);
+	if(str.getSize() == 0)
+		return;
+
+	float hspace	= font.getGlyph(L' ', size_px, false).advance;
+	float vspace	= font.getLineSpacing(size_px);
+	float x			= 0;
+	float y			= float(size_px);
+	float min_x		= float(size_px);
+	float min_y		= float(size_px);
+	float max_x		= 0;
+	float max_y		= 0;
+	sf::Uint32 prev	= 0;
+
+	for(std::size_t i = 0; i < str.getSize(); ++i)
+	{
+		sf::Uint32 curr = str[i];
+		x += font.getKerning(prev, curr, size_px);
+		prev = curr;
+
+		// Whitespace only moves the pen.
+		if(curr == ' ' || curr == '\t' || curr == '\n')
+		{
+			min_x = min(min_x, x);
+			min_y = min(min_y, y);
+			if(curr == ' ')
+				x += hspace;
+			else if(curr == '\t')
+				x += hspace * 4;
+			else
+			{
+				y += vspace;
+				x = 0;
+			}
+			max_x = max(max_x, x);
+			max_y = max(max_y, y);
+			continue;
+		}
+
+		const sf::Glyph& glyph = font.getGlyph(curr, size_px, false);
+		float left		= x + glyph.bounds.left;
+		float top		= y + glyph.bounds.top;
+		float right		= left + glyph.bounds.width;
+		float bottom	= top + glyph.bounds.height;
+		float u1		= float(glyph.textureRect.left);
+		float v1		= float(glyph.textureRect.top);
+		float u2		= float(glyph.textureRect.left + glyph.textureRect.width);
+		float v2		= float(glyph.textureRect.top + glyph.textureRect.height);
+
+		vertices.push_back(sf::Vertex(sf::Vector2f(left, top),		sf::Color::White, sf::Vector2f(u1, v1)));
+		vertices.push_back(sf::Vertex(sf::Vector2f(right, top),		sf::Color::White, sf::Vector2f(u2, v1)));
+		vertices.push_back(sf::Vertex(sf::Vector2f(left, bottom),	sf::Color::White, sf::Vector2f(u1, v2)));
+		vertices.push_back(sf::Vertex(sf::Vector2f(left, bottom),	sf::Color::White, sf::Vector2f(u1, v2)));
+		vertices.push_back(sf::Vertex(sf::Vector2f(right, top),		sf::Color::White, sf::Vector2f(u2, v1)));
+		vertices.push_back(sf::Vertex(sf::Vector2f(right, bottom),	sf::Color::White, sf::Vector2f(u2, v2)));
+
+		min_x = min(min_x, left);
+		max_x = max(max_x, right);
+		min_y = min(min_y, top);
+		max_y = max(max_y, bottom);
+
+		x += glyph.advance;
+	}
+
+	sf::Vector2f origin(0, 0);
+	if(align == TextAlign::Centre)
+		origin = sf::Vector2f((max_x - min_x) * 0.5f, (max_y - min_y) * 0.5f);
+
+	for(sf::Vertex& v : vertices)
+		v.position = (v.position - origin) * scale;
+}
+
+static u64 TextRunKey(const char* text, FontId font, u32 size_px, TextAlign align, float scale)
+{
+	// FNV-1a over the string, followed by the layout parameters.
+	u64 hash = 14695981039346656037ull;
+	for(const char* c = text; *c; ++c)
+		hash = (hash ^ u8(*c)) * 1099511628211ull;
+
+	u32 scale_bits;
+	memcpy(&scale_bits, &scale, sizeof(scale_bits));
+	u32 params[4] = { font, size_px, u32(align), scale_bits };
+	for(u32 p : params)
+		hash = (hash ^ p) * 1099511628211ull;
+	return hash;
+}
+
+static void EvictTextRun(std::list<TextRun>::iterator run)
+{
+	g_text_cache_bytes -= run->bytes;
+	g_text_run_lookup.erase(run->key);
+	g_text_runs.erase(run);
+}
+
+// Returns the cached layout for the given parameters, laying it out if it isn't cached.
+static const TextRun& GetTextRun(const char* text, FontId font, u32 size_px, TextAlign align, float scale)
+{
+	u64 key = TextRunKey(text, font, size_px, align, scale);
+	auto found = g_text_run_lookup.find(key);
+	if(found != g_text_run_lookup.end())
+	{
+		// Hash collisions are treated as a miss, replacing the existing run.
+		if(found->second->text == text)
+		{
+			++g_text_cache_hits;
+			g_text_runs.splice(g_text_runs.begin(), g_text_runs, found->second);
+			return g_text_runs.front();
+		}
+		EvictTextRun(found->second);
+	}
+
+	++g_text_cache_misses;
+	++g_render_stats.text_layouts;
+	g_text_runs.push_front(TextRun());
+	TextRun& run = g_text_runs.front();
+	run.key = key;
+	run.text = text;
+	LayoutTextRun(text, g_fonts[font], size_px, align, scale, run.vertices);
+	run.bytes = u32(sizeof(TextRun) + run.text.size() + run.vertices.size() * sizeof(sf::Vertex));
+	g_text_run_lookup[key] = g_text_runs.begin();
+	g_text_cache_bytes += run.bytes;
+
+	// Evict the least recently used runs until we're back within budget, always keeping the new one.
+	while(g_text_cache_bytes > g_text_cache_budget && g_text_runs.size() > 1)
+		EvictTextRun(std::prev(g_text_runs.end()));
+
+	return run;
+}
+
+void DrawText(const char* text, FontId font, f2 pos, u32 size_px, f4 col, TextAlign align, float scale)
+{
+	PROFILE_SCOPE("DrawText");
+
+	if(g_total_fonts == 0)
+		return;
+
+	if(font >= g_total_fonts)
+	{
+		printf("Font ID is not valid!\n");
+		return;
+	}
+
+	const TextRun& run = GetTextRun(text, font, size_px, align, scale);
+	if(run.vertices.empty())
+		return;
+
+	// Text joins the batch like any other geometry, so strings sharing a font page share a draw call.
+	FlushSpriteLayer();
+	SetBatchTexture(&g_fonts[font].getTexture(size_px));
+
+	sf::Color c = Col(col);
+	sf::Vector2f offset(pos.x, pos.y);
+	for(const sf::Vertex& v : run.vertices)
+		g_batch_vertices.append(sf::Vertex(v.position + offset, c, v.texCoords));
+	++g_batch_submissions;
+
+	if(!g_batching_enabled)
+		FlushBatchVertices();
+}
+
+void SetTextCacheBudget(u32 bytes)
+{
+	g_text_cache_budget = bytes;
+	while(g_text_cache_bytes > g_text_cache_budget && !g_text_runs.empty())
+		EvictTextRun(std::prev(g_text_runs.end()));
+}
+
+u32 GetTextCacheHits()
+{
+	return g_text_cache_hits;
+}
+
+u32 GetTextCacheMisses()
+{
+	return g_text_cache_misses;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Graphics API
+//////////////////////////////////////////////////////////////////////////
+
+void SetBatchingEnabled(bool b)
+{
+	if(!b)
+		FlushBatch();
+	g_batching_enabled = b;
+}
+
+u32 GetDrawCallsSaved()
+{
+	return GetRenderStats().draw_calls_saved;
+}
+
+RenderStats GetRenderStats()
+{
+	if(g_render_stats_frames == 0)
+		return RenderStats();
+	return g_render_stats_history[(g_render_stats_frames - 1) % RENDER_STATS_HISTORY];
+}
+
+// Combines each stat over the recorded history with the given operation.
+template <typename Op>
+static RenderStats CombineRenderStats(Op op)
+{
+	u32 frames = min(g_render_stats_frames, RENDER_STATS_HISTORY);
+	if(frames == 0)
+		return RenderStats();
+
+	RenderStats result = g_render_stats_history[0];
+	for(u32 i = 1; i < frames; ++i)
+	{
+		const RenderStats& s = g_render_stats_history[i];
+		result.draw_calls			= op(result.draw_calls, s.draw_calls);
+		result.vertices				= op(result.vertices, s.vertices);
+		result.texture_binds		= op(result.texture_binds, s.texture_binds);
+		result.shader_binds			= op(result.shader_binds, s.shader_binds);
+		result.post_effect_copies	= op(result.post_effect_copies, s.post_effect_copies);
+		result.text_layouts			= op(result.text_layouts, s.text_layouts);
+		result.draw_calls_saved		= op(result.draw_calls_saved, s.draw_calls_saved);
+	}
+	return result;
+}
+
+RenderStats GetRenderStatsMin()
+{
+	return CombineRenderStats([](u32 a, u32 b) { return min(a, b); });
+}
+
+RenderStats GetRenderStatsMax()
+{
+	return CombineRenderStats([](u32 a, u32 b) { return max(a, b); });
+}
+
+RenderStats GetRenderStatsAvg()
+{
+	u32 frames = max(min(g_render_stats_frames, RENDER_STATS_HISTORY), 1u);
+	RenderStats sum = CombineRenderStats([](u32 a, u32 b) { return a + b; });
+	sum.draw_calls			/= frames;
+	sum.vertices			/= frames;
+	sum.texture_binds		/= frames;
+	sum.shader_binds		/= frames;
+	sum.post_effect_copies	/= frames;
+	sum.text_layouts		/= frames;
+	sum.draw_calls_saved	/= frames;
+	return sum;
+}
+
+void DrawQuad(f2 pos, f2 size, f4 col, QuadAlign align)
+{
+	PROFILE_SCOPE("DrawQuad");
+
+	if(align == QuadAlign::Centre)
+		pos -= size * 0.5f;
+
+	sf::Color c = Col(col);
+	sf::Vertex quad[4] =
+	{
+		sf::Vertex(sf::Vector2f(pos.x,			pos.y),				c),
+		sf::Vertex(sf::Vector2f(pos.x + size.x,	pos.y),				c),
+		sf::Vertex(sf::Vector2f(pos.x + size.x,	pos.y + size.y),	c),
+		sf::Vertex(sf::Vector2f(pos.x,			pos.y + size.y),	c),
+	};
+	BatchQuad(quad, nullptr);
+}
+
+void DrawQuad(f2 startpos, f2 endpos, float width, f4 col)
+{
+	PROFILE_SCOPE("DrawLine");
+
+	f2 dir = endpos - startpos;
+	float len = length(dir);
+	if(len <= 0)
+		return;
+
+	// Offset both ends by half the width, perpendicular to the line.
+	f2 side = perp(dir) * (width * 0.5f / len);
+	f2 p0 = startpos - side;
+	f2 p1 = startpos + side;
+	f2 p2 = endpos + side;
+	f2 p3 = endpos - side;
+
+	sf::Color c = Col(col);
+	sf::Vertex quad[4] =
+	{
+		sf::Vertex(sf::Vector2f(p0.x, p0.y), c),
+		sf::Vertex(sf::Vector2f(p1.x, p1.y), c),
+		sf::Vertex(sf::Vector2f(p2.x, p2.y), c),
+		sf::Vertex(sf::Vector2f(p3.x, p3.y), c),
+	};
+	BatchQuad(quad, nullptr);
+}
+
+// Returns the precomputed unit circle (one point per segment) with enough segments for a circle of the given on-screen radius.
+static const std::vector<f2>& GetUnitCircle(float radius_px)
+{
+	// Segments needed to keep the error within tolerance, rounded up to the next LOD.
+	float error = min(g_circle_tolerance / max(radius_px, 0.001f), 1.0f);
+	float segments_needed = float(PI / acos(1.0f - error));
+	u32 lod = 0;
+	while(lod < CIRCLE_LODS - 1 && float(MIN_CIRCLE_SEGMENTS << lod) < segments_needed)
+		++lod;
+
+	std::vector<f2>& circle = g_unit_circles[lod];
+	if(circle.empty())
+	{
+		u32 segments = MIN_CIRCLE_SEGMENTS << lod;
+		circle.resize(segments);
+		for(u32 i = 0; i < segments; ++i)
+			circle[i] = f2(float(cos(i * 2 * PI / segments)), float(sin(i * 2 * PI / segments)));
+	}
+	return circle;
+}
+
+void DrawCircle(f2 pos, float radius, f4 col)
+{
+	PROFILE_SCOPE("DrawCircle");
+
+	// Pick the level of detail from the circle's size in pixels, under the current world region.
+	const sf::View& view = g_target->getView();
+	float pixels_per_unit = view.getViewport().width * g_target->getSize().x / view.getSize().x;
+	const std::vector<f2>& circle = GetUnitCircle(radius * fabs(pixels_per_unit));
+
+	// Emit a triangle fan around the centre, as a triangle list so it joins the batch.
+	FlushSpriteLayer();
+	SetBatchTexture(nullptr);
+
+	sf::Color c = Col(col);
+	sf::Vertex centre(sf::Vector2f(pos.x, pos.y), c);
+	f2 prev = pos + circle.back() * radius;
+	for(f2 dir : circle)
+	{
+		f2 p = pos + dir * radius;
+		g_batch_vertices.append(centre);
+		g_batch_vertices.append(sf::Vertex(sf::Vector2f(prev.x, prev.y), c));
+		g_batch_vertices.append(sf::Vertex(sf::Vector2f(p.x, p.y), c));
+		prev = p;
+	}
+	++g_batch_submissions;
+
+	if(!g_batching_enabled)
+		FlushBatchVertices();
+}
+
+void SetCircleTolerance(float pixels)
+{
+	g_circle_tolerance = max(pixels, 0.01f);
+}
+
+static u32 AtlasPageSize()
+{
+	return min(ATLAS_PAGE_SIZE, sf::Texture::getMaximumSize());
+}
+
+// Finds the height a w-wide rect would sit at if placed at the given skyline node, or -1 if it doesn't fit.
+static int SkylineFit(const std::vector<SkylineNode>& skyline, u32 node, int w, int h)
+{
+	int page_size = int(AtlasPageSize());
+	if(skyline[node].x + w > page_size)
+		return -1;
+
+	int y = 0;
+	for(int width_left = w; width_left > 0; width_left -= skyline[node++].width)
+	{
+		y = max(y, skyline[node].y);
+		if(y + h > page_size)
+			return -1;
+	}
+	return y;
+}
+
+// Packs a w*h rect into the skyline using the bottom-left heuristic.
+static bool SkylineInsert(std::vector<SkylineNode>& skyline, int w, int h, int& out_x, int& out_y)
+{
+	int best_y = -1;
+	int best_width = 0;
+	u32 best_node = 0;
+	for(u32 i = 0; i < skyline.size(); ++i)
+	{
+		int y = SkylineFit(skyline, i, w, h);
+		if(y >= 0 && (best_y < 0 || y < best_y || (y == best_y && skyline[i].width < best_width)))
+		{
+			best_y = y;
+			best_width = skyline[i].width;
+			best_node = i;
+		}
+	}
+
+	if(best_y < 0)
+		return false;
+
+	out_x = skyline[best_node].x;
+	out_y = best_y;
+	SkylineNode node = { out_x, out_y + h, w };
+	skyline.insert(skyline.begin() + best_node, node);
+
+	// Trim the nodes now covered by the new one.
+	for(u32 i = best_node + 1; i < skyline.size();)
+	{
+		int covered = skyline[i - 1].x + skyline[i - 1].width - skyline[i].x;
+		if(covered <= 0)
+			break;
+
+		skyline[i].x += covered;
+		skyline[i].width -= covered;
+		if(skyline[i].width > 0)
+			break;
+		skyline.erase(skyline.begin() + i);
+	}
+
+	// Merge neighbouring nodes at the same height.
+	for(u32 i = 0; i + 1 < skyline.size();)
+	{
+		if(skyline[i].y == skyline[i + 1].y)
+		{
+			skyline[i].width += skyline[i + 1].width;
+			skyline.erase(skyline.begin() + i + 1);
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	return true;
+}
+
+// Packs an image into an atlas page, extruding its edges into the padding so smoothing doesn't bleed.
+static bool AddTextureToAtlas(TextureId id, const sf::Image& image)
+{
+	sf::Vector2u size = image.getSize();
+	if(size.x > ATLAS_MAX_TEXTURE_SIZE || size.y > ATLAS_MAX_TEXTURE_SIZE || size.x == 0 || size.y == 0)
+		return false;
+
+	int padded_w = int(size.x) + ATLAS_PADDING * 2;
+	int padded_h = int(size.y) + ATLAS_PADDING * 2;
+	int x = 0, y = 0;
+	u32 page = 0;
+	for(; page < g_total_atlas_pages; ++page)
+	{
+		if(SkylineInsert(g_atlas_skylines[page], padded_w, padded_h, x, y))
+			break;
+	}
+
+	// Start a new page if nothing had room.
+	if(page == g_total_atlas_pages)
+	{
+		if(g_total_atlas_pages == MAX_ATLAS_PAGES || !g_atlas_pages[page].create(AtlasPageSize(), AtlasPageSize()))
+			return false;
+
+		g_atlas_pages[page].setSmooth(true);
+		g_atlas_skylines[page].assign(1, SkylineNode { 0, 0, int(AtlasPageSize()) });
+		++g_total_atlas_pages;
+		if(!SkylineInsert(g_atlas_skylines[page], padded_w, padded_h, x, y))
+			return false;
+	}
+
+	std::vector<sf::Uint8> padded(padded_w * padded_h * 4);
+	const sf::Uint8* src = image.getPixelsPtr();
+	for(int py = 0; py < padded_h; ++py)
+	{
+		int sy = clamp(py - ATLAS_PADDING, 0, int(size.y) - 1);
+		for(int px = 0; px < padded_w; ++px)
+		{
+			int sx = clamp(px - ATLAS_PADDING, 0, int(size.x) - 1);
+			memcpy(&padded[(py * padded_w + px) * 4], &src[(sy * size.x + sx) * 4], 4);
+		}
+	}
+	g_atlas_pages[page].update(&padded[0], padded_w, padded_h, x, y);
+
+	g_texture_sources[id] = &g_atlas_pages[page];
+	g_texture_rects[id] = sf::IntRect(x + ATLAS_PADDING, y + ATLAS_PADDING, size.x, size.y);
+	g_atlas_used_texels += size.x * size.y;
+	return true;
+}
+
+// Uploads a decoded image to the given texture ID, either into an atlas page or a texture of its own.
+static bool InitTextureFromImage(TextureId id, const sf::Image& image)
+{
+	if(g_texture_atlasing && AddTextureToAtlas(id, image))
+		return true;
+
+	if(!g_textures[id].loadFromImage(image))
+		return false;
+
+	g_textures[id].setSmooth(true);
+	g_texture_sources[id] = &g_textures[id];
+	g_texture_rects[id] = sf::IntRect(0, 0, image.getSize().x, image.getSize().y);
+	return true;
+}
+
+TextureId LoadTexture(const char* path)
+{
+	if(g_total_textures < MAX_TEXTURES)
+	{
+		sf::Image image;
+		const u8* data;
+		u32 size;
+		bool loaded = FindPackedAsset(path, data, size) ? image.loadFromMemory(data, size) : image.loadFromFile(path);
+		if(loaded && InitTextureFromImage(TextureId(g_total_textures), image))
+		{
+			return g_total_textures++;
+		}
+
+		printf("[ERR]: Couldn't load texture file from %s\n", path);
+		return -1;
+	}
+
+	printf("[ERR]: No remaining texture memory!\n");
+	return -1;
+}
+
+TextureId LoadTextureAsync(const char* path)
+{
+	if(g_total_textures < MAX_TEXTURES)
+	{
+		// Draw the placeholder until the texture has been uploaded.
+		TextureId id = TextureId(g_total_textures++);
+		g_texture_sources[id] = &g_no_texture;
+		g_texture_rects[id] = sf::IntRect(0, 0, 1, 1);
+		QueueAsyncLoad(AsyncLoadType::Texture, id, path);
+		return id;
+	}
+
+	printf("[ERR]: No remaining texture memory!\n");
+	return -1;
+}
+
+void SetTextureAtlasing(bool b)
+{
+	g_texture_atlasing = b;
+}
+
+u32 GetTextureAtlasPageCount()
+{
+	return g_total_atlas_pages;
+}
+
+float GetTextureAtlasEfficiency()
+{
+	if(g_total_atlas_pages == 0)
+		return 0;
+	return float(double(g_atlas_used_texels) / (double(AtlasPageSize()) * AtlasPageSize() * g_total_atlas_pages));
+}
+
+// Returns the slot index for a live sprite ID, or MAX_SPRITES if the ID is invalid or stale.
+static u32 GetSpriteIndex(SpriteId sprite)
+{
+	u32 idx = sprite & SPRITE_INDEX_MASK;
+	if(idx >= g_total_sprites || g_sprite_generations[idx] != (sprite >> SPRITE_INDEX_BITS))
+		return MAX_SPRITES;
+	return idx;
+}
+
+// As above, but reports invalid IDs.
+static u32 GetCheckedSpriteIndex(SpriteId sprite)
+{
+	u32 idx = GetSpriteIndex(sprite);
+	if(idx == MAX_SPRITES)
+		printf("[ERR]: Invalid sprite ID!\n");
+	return idx;
+}
+
+SpriteId CreateSprite(TextureId texture_id, SpriteOrigin origin)
+{
+	if(texture_id >= g_total_textures)
+	{
+		printf("[ERR]: Invalid texture ID!\n");
+		return -1;
+	}
+
+	// Reuse a destroyed slot if there is one, otherwise take a fresh one.
+	u32 idx;
+	if(g_sprite_free_head != NO_FREE_SPRITE)
+	{
+		idx = g_sprite_free_head;
+		g_sprite_free_head = g_sprite_next_free[idx];
+	}
+	else if(g_total_sprites < MAX_SPRITES)
+	{
+		idx = g_total_sprites++;
+	}
+	else
+	{
+		printf("[ERR]: Out of sprite memory!\n");
+		return -1;
+	}
+
+	g_sprite_textures[idx]	= texture_id;
+	g_sprite_positions[idx]	= f2(0);
+	g_sprite_rotations[idx]	= 0;
+	g_sprite_scales[idx]	= f2(1);
+	g_sprite_colours[idx]	= sf::Color::White;
+	g_sprite_origins[idx]	= origin == SpriteOrigin::Centre ? f2(0.5f) : f2(0);
+
+	return (SpriteId(g_sprite_generations[idx]) << SPRITE_INDEX_BITS) | idx;
+}
+
+void DestroySprite(SpriteId sprite)
+{
+	u32 idx = GetCheckedSpriteIndex(sprite);
+	if(idx == MAX_SPRITES)
+		return;
+
+	// Bumping the generation invalidates any IDs still referring to this slot.
+	++g_sprite_generations[idx];
+	g_sprite_next_free[idx] = g_sprite_free_head;
+	g_sprite_free_head = u16(idx);
+}
+
+// Generates the transformed quad for a sprite slot straight from the sprite arrays, and batches it.
+static void BatchSpriteSlot(u32 idx, int xsegments, int xsegment)
+{
+	TextureId texture = g_sprite_textures[idx];
+	sf::FloatRect rect(g_texture_rects[texture]);
+	f2 origin = g_sprite_origins[idx] * f2(rect.width, rect.height);
+	if(xsegments >= 0)
+	{
+		float s = rect.width / (float)xsegments;
+		rect = sf::FloatRect(rect.left + float(int(xsegment * s)), rect.top, float(int(s)), rect.height);
+	}
+
+	// Local axes after rotation and scaling, matching sf::Transformable.
+	float rot = g_sprite_rotations[idx];
+	f2 scale = g_sprite_scales[idx];
+	f2 axis_x = f2(cos(rot), sin(rot)) * scale.x;
+	f2 axis_y = f2(-sin(rot), cos(rot)) * scale.y;
+	f2 p0 = g_sprite_positions[idx] - axis_x * origin.x - axis_y * origin.y;
+	f2 p1 = p0 + axis_x * rect.width;
+	f2 p2 = p1 + axis_y * rect.height;
+	f2 p3 = p0 + axis_y * rect.height;
+
+	sf::Color c = g_sprite_colours[idx];
+	sf::Vertex quad[4] =
+	{
+		sf::Vertex(sf::Vector2f(p0.x, p0.y), c, sf::Vector2f(rect.left,				rect.top)),
+		sf::Vertex(sf::Vector2f(p1.x, p1.y), c, sf::Vector2f(rect.left + rect.width,	rect.top)),
+		sf::Vertex(sf::Vector2f(p2.x, p2.y), c, sf::Vector2f(rect.left + rect.width,	rect.top + rect.height)),
+		sf::Vertex(sf::Vector2f(p3.x, p3.y), c, sf::Vector2f(rect.left,				rect.top + rect.height)),
+	};
+	BatchSprite(quad, g_texture_sources[texture]);
+}
+
+void DrawSprite(SpriteId sprite, int xsegments, int xsegment)
+{
+	PROFILE_SCOPE("DrawSprite");
+
+	u32 idx = GetSpriteIndex(sprite);
+	if(idx < MAX_SPRITES)
+		BatchSpriteSlot(idx, xsegments, xsegment);
+}
+
+void DrawSprites(const SpriteId* sprites, u32 count)
+{
+	PROFILE_SCOPE("DrawSprites");
+
+	for(u32 i = 0; i < count; ++i)
+	{
+		u32 idx = GetSpriteIndex(sprites[i]);
+		if(idx < MAX_SPRITES)
+			BatchSpriteSlot(idx, -1, 0);
+	}
+}
+
+void DrawSprite(TextureId texture, f2 pos, f4 col)
+{
+	PROFILE_SCOPE("DrawSprite");
+
+	if(texture>=g_total_textures)
+		return;
+
+	sf::FloatRect rect(g_texture_rects[texture]);
+	f2 size = f2(rect.width, rect.height);
+	sf::Color c = Col(col);
+	sf::Vertex quad[4] =
+	{
+		sf::Vertex(sf::Vector2f(pos.x,			pos.y),				c, sf::Vector2f(rect.left,			rect.top)),
+		sf::Vertex(sf::Vector2f(pos.x + size.x,	pos.y),				c, sf::Vector2f(rect.left + size.x,	rect.top)),
+		sf::Vertex(sf::Vector2f(pos.x + size.x,	pos.y + size.y),	c, sf::Vector2f(rect.left + size.x,	rect.top + size.y)),
+		sf::Vertex(sf::Vector2f(pos.x,			pos.y + size.y),	c, sf::Vector2f(rect.left,			rect.top + size.y)),
+	};
+	BatchSprite(quad, g_texture_sources[texture]);
+}
+
+void BeginSpriteLayer()
+{
+	FlushSpriteLayer();
+	g_sprite_layer_active = true;
+}
+
+void EndSpriteLayer()
+{
+	FlushSpriteLayer();
+	g_sprite_layer_active = false;
+}
+
+f2 GetPosition(SpriteId sprite)
+{
+	u32 idx = GetCheckedSpriteIndex(sprite);
+	return idx < MAX_SPRITES ? g_sprite_positions[idx] : f2(0);
+}
+
+float GetRotation(SpriteId sprite)
+{
+	u32 idx = GetCheckedSpriteIndex(sprite);
+	return idx < MAX_SPRITES ? g_sprite_rotations[idx] : 0;
+}
+
+f2 GetScale(SpriteId sprite)
+{
+	u32 idx = GetCheckedSpriteIndex(sprite);
+	return idx < MAX_SPRITES ? g_sprite_scales[idx] : f2(1);
+}
+
+void SetPosition(SpriteId sprite, f2 pos)
+{
+	u32 idx = GetCheckedSpriteIndex(sprite);
+	if(idx < MAX_SPRITES)
+		g_sprite_positions[idx] = pos;
+}
+
+void SetRotation(SpriteId sprite, float ang)
+{
+	u32 idx = GetCheckedSpriteIndex(sprite);
+	if(idx < MAX_SPRITES)
+		g_sprite_rotations[idx] = ang;
+}
+
+void SetScale(SpriteId sprite, f2 scale)
+{
+	u32 idx = GetCheckedSpriteIndex(sprite);
+	if(idx < MAX_SPRITES)
+		g_sprite_scales[idx] = scale;
+}
+
+void SetColour(SpriteId sprite, f4 col)
+{
+	u32 idx = GetCheckedSpriteIndex(sprite);
+	if(idx < MAX_SPRITES)
+		g_sprite_colours[idx] = Col(col);
+}
+
+void SetPositions(const SpriteId* sprites, const f2* positions, u32 count)
+{
+	for(u32 i = 0; i < count; ++i)
+	{
+		u32 idx = GetCheckedSpriteIndex(sprites[i]);
+		if(idx < MAX_SPRITES)
+			g_sprite_positions[idx] = positions[i];
+	}
+}
+
+void SetRotations(const SpriteId* sprites, const float* angs, u32 count)
+{
+	for(u32 i = 0; i < count; ++i)
+	{
+		u32 idx = GetCheckedSpriteIndex(sprites[i]);
+		if(idx < MAX_SPRITES)
+			g_sprite_rotations[idx] = angs[i];
+	}
+}
+
+void SetScales(const SpriteId* sprites, const f2* scales, u32 count)
+{
+	for(u32 i = 0; i < count; ++i)
+	{
+		u32 idx = GetCheckedSpriteIndex(sprites[i]);
+		if(idx < MAX_SPRITES)
+			g_sprite_scales[idx] = scales[i];
+	}
+}
+
+void SetColours(const SpriteId* sprites, const f4* cols, u32 count)
+{
+	for(u32 i = 0; i < count; ++i)
+	{
+		u32 idx = GetCheckedSpriteIndex(sprites[i]);
+		if(idx < MAX_SPRITES)
+			g_sprite_colours[idx] = Col(cols[i]);
+	}
+}
+
+// Returns the emitter for a live emitter ID, reporting invalid IDs.
+static ParticleEmitter* GetEmitter(EmitterId emitter)
+{
+	if(emitter >= MAX_EMITTERS || !g_emitters[emitter].live)
+	{
+		printf("[ERR]: Invalid emitter ID!\n");
+		return nullptr;
+	}
+	return &g_emitters[emitter];
+}
+
+// Sets the colour and size of a range of particles from their ages, using the sampled curves.
+static void ShadeParticles(ParticleEmitter& e, u32 first, u32 last)
+{
+	const ParticleSettings& ps = e.settings;
+	f4 colour_delta = ps.end_colour - ps.start_colour;
+	float size_delta = ps.end_size - ps.start_size;
+	for(u32 i = first; i < last; ++i)
+	{
+		u32 sample = u32(min(e.ages[i] * e.inv_lives[i], 1.0f) * PARTICLE_CURVE_SAMPLES);
+		e.colours[i] = Col(ps.start_colour + colour_delta * e.colour_curve[sample]);
+		e.sizes[i] = ps.start_size + size_delta * e.size_curve[sample];
+	}
+}
+
+static void SpawnParticles(ParticleEmitter& e, u32 count)
+{
+	const ParticleSettings& ps = e.settings;
+	u32 first = e.count;
+	u32 last = first + min(count, ps.max_particles - first);
+	for(u32 i = first; i < last; ++i)
+	{
+		float ang = ps.direction + float(RandNorm() - 0.5) * ps.spread;
+		float speed = lerp(ps.speed_min, ps.speed_max, float(RandNorm()));
+		float life = lerp(ps.life_min, ps.life_max, float(RandNorm()));
+		e.pos_x[i] = e.pos.x;
+		e.pos_y[i] = e.pos.y;
+		e.vel_x[i] = cos(ang) * speed;
+		e.vel_y[i] = sin(ang) * speed;
+		e.ages[i] = 0;
+		e.inv_lives[i] = 1 / max(life, 0.001f);
+	}
+	e.count = last;
+	ShadeParticles(e, first, last);
+}
+
+static void UpdateParticles(float dt)
+{
+	PROFILE_SCOPE("UpdateParticles");
+
+	for(ParticleEmitter& e : g_emitters)
+	{
+		if(!e.live)
+			continue;
+
+		e.spawn_accumulator += e.settings.rate * dt;
+		u32 spawn_count = u32(e.spawn_accumulator);
+		e.spawn_accumulator -= float(spawn_count);
+		SpawnParticles(e, spawn_count);
+
+		// Integrate. Kept free of branches, so the compiler can vectorise it.
+		float damping = max(1 - e.settings.drag * dt, 0.0f);
+		f2 dv = e.settings.gravity * dt;
+		float* pos_x = e.pos_x.data();
+		float* pos_y = e.pos_y.data();
+		float* vel_x = e.vel_x.data();
+		float* vel_y = e.vel_y.data();
+		float* ages = e.ages.data();
+		for(u32 i = 0; i < e.count; ++i)
+		{
+			vel_x[i] = (vel_x[i] + dv.x) * damping;
+			vel_y[i] = (vel_y[i] + dv.y) * damping;
+			pos_x[i] += vel_x[i] * dt;
+			pos_y[i] += vel_y[i] * dt;
+			ages[i] += dt;
+		}
+
+		// Remove dead particles by moving the last live particle into their place.
+		for(u32 i = 0; i < e.count;)
+		{
+			if(ages[i] * e.inv_lives[i] < 1)
+			{
+				++i;
+				continue;
+			}
+			u32 last = --e.count;
+			pos_x[i] = pos_x[last];
+			pos_y[i] = pos_y[last];
+			vel_x[i] = vel_x[last];
+			vel_y[i] = vel_y[last];
+			ages[i] = ages[last];
+			e.inv_lives[i] = e.inv_lives[last];
+		}
+
+		ShadeParticles(e, 0, e.count);
+	}
+}
+
+EmitterId CreateEmitter(const ParticleSettings& settings)
+{
+	for(u16 i = 0; i < MAX_EMITTERS; ++i)
+	{
+		if(g_emitters[i].live)
+			continue;
+
+		ParticleEmitter& e = g_emitters[i];
+		e.live = true;
+		e.pos = f2(0);
+		e.spawn_accumulator = 0;
+		e.count = 0;
+		SetEmitterSettings(i, settings);
+		return i;
+	}
+
+	printf("[ERR]: Out of emitter memory!\n");
+	return -1;
+}
+
+void DestroyEmitter(EmitterId emitter)
+{
+	ParticleEmitter* e = GetEmitter(emitter);
+	if(!e)
+		return;
+
+	// Release the particle memory too.
+	*e = ParticleEmitter();
+}
+
+void SetEmitterSettings(EmitterId emitter, const ParticleSettings& settings)
+{
+	ParticleEmitter* e = GetEmitter(emitter);
+	if(!e)
+		return;
+
+	e->settings = settings;
+	for(u32 i = 0; i <= PARTICLE_CURVE_SAMPLES; ++i)
+	{
+		float t = float(i) / PARTICLE_CURVE_SAMPLES;
+		e->colour_curve[i] = settings.colour_ease(t, settings.colour_easing);
+		e->size_curve[i] = settings.size_ease(t, settings.size_easing);
+	}
+
+	u32 capacity = settings.max_particles;
+	e->count = min(e->count, capacity);
+	e->pos_x.resize(capacity);
+	e->pos_y.resize(capacity);
+	e->vel_x.resize(capacity);
+	e->vel_y.resize(capacity);
+	e->ages.resize(capacity);
+	e->inv_lives.resize(capacity);
+	e->colours.resize(capacity);
+	e->sizes.resize(capacity);
+	e->vertices.resize(capacity * 6);
+	ShadeParticles(*e, 0, e->count);
+}
+
+void SetEmitterPosition(EmitterId emitter, f2 pos)
+{
+	if(ParticleEmitter* e = GetEmitter(emitter))
+		e->pos = pos;
+}
+
+void EmitParticles(EmitterId emitter, u32 count)
+{
+	if(ParticleEmitter* e = GetEmitter(emitter))
+		SpawnParticles(*e, count);
+}
+
+void DrawEmitter(EmitterId emitter)
+{
+	PROFILE_SCOPE("DrawEmitter");
+
+	ParticleEmitter* e = GetEmitter(emitter);
+	if(!e || e->count == 0)
+		return;
+
+	TextureId texture = e->settings.texture;
+	bool textured = texture < g_total_textures;
+	sf::FloatRect rect = textured ? sf::FloatRect(g_texture_rects[texture]) : sf::FloatRect();
+	sf::Vector2f uv0(rect.left, rect.top);
+	sf::Vector2f uv1(rect.left + rect.width, rect.top);
+	sf::Vector2f uv2(rect.left + rect.width, rect.top + rect.height);
+	sf::Vector2f uv3(rect.left, rect.top + rect.height);
+
+	sf::Vertex* v = e->vertices.data();
+	for(u32 i = 0; i < e->count; ++i, v += 6)
+	{
+		// Written field by field, as sf::Vertex's constructors aren't inlined.
+		float half_size = e->sizes[i] * 0.5f;
+		float x0 = e->pos_x[i] - half_size, x1 = e->pos_x[i] + half_size;
+		float y0 = e->pos_y[i] - half_size, y1 = e->pos_y[i] + half_size;
+		sf::Color c = e->colours[i];
+		v[0].position.x = x0; v[0].position.y = y0; v[0].color = c; v[0].texCoords = uv0;
+		v[1].position.x = x1; v[1].position.y = y0; v[1].color = c; v[1].texCoords = uv1;
+		v[2].position.x = x1; v[2].position.y = y1; v[2].color = c; v[2].texCoords = uv2;
+		v[5].position.x = x0; v[5].position.y = y1; v[5].color = c; v[5].texCoords = uv3;
+		v[3] = v[0];
+		v[4] = v[2];
+	}
+
+	// Draw everything batched so far first, to keep the draw order.
+	FlushBatch();
+	const sf::Texture* source = textured ? g_texture_sources[texture] : nullptr;
+	u32 vertex_count = e->count * 6;
+	g_target->draw(e->vertices.data(), vertex_count, sf::Triangles, sf::RenderStates(source));
+	CountDrawCall(vertex_count, source, nullptr);
+	g_batch_submissions += e->count;
+	++g_batch_draw_calls;
+}
+
+u32 GetParticleCount(EmitterId emitter)
+{
+	ParticleEmitter* e = GetEmitter(emitter);
+	return e ? e->count : 0;
+}
+
+static ShaderId LoadShaderInternal(const char* strarg, bool fromfile)
+{
+	if(!sf::Shader::isAvailable())
+	{
+		printf("[ERR]: Shaders not available on your platform! :(\n");
+		return -1;
+	}
+
+	if(g_total_shaders < MAX_SHADERS)
+	{
+		// Packed shaders still need copying into a string for SFML, and aren't hot reloaded.
+		const u8* data;
+		u32 size;
+		bool packed = fromfile && FindPackedAsset(strarg, data, size);
+		bool success;
+		if(packed)
+			success = g_shaders[g_total_shaders][0].loadFromMemory(std::string((const char*)data, size), sf::Shader::Fragment);
+		else
+			success = fromfile	? g_shaders[g_total_shaders][0].loadFromFile(strarg, sf::Shader::Fragment)
+								: g_shaders[g_total_shaders][0].loadFromMemory(strarg, sf::Shader::Fragment);
+		if (success)
+		{
+			// Remember where the shader came from, in case it is hot reloaded.
+			std::lock_guard<std::mutex> lock(g_shader_watcher.mutex);
+			g_shader_watcher.paths.resize(g_total_shaders + 1);
+			g_shader_watcher.paths[g_total_shaders] = fromfile && !packed ? strarg : "";
+			return g_total_shaders++;
+		}
+	}
+
+	if(fromfile)
+		printf("[ERR]: Could not load shader from file %s\n", strarg);
+	else
+		printf("[ERR]: Could not load shader from memory!\n");
+
+	return -1;
+}
+
+ShaderId LoadShaderFromString(const char* str)
+{
+	return LoadShaderInternal(str, false);
+}
+
+ShaderId LoadShaderFromFile(const char* path)
+{
+	return LoadShaderInternal(path, true);
+}
+
+// Returns the file's modification time, or 0 if it can't be read.
+static u64 GetFileModifiedTime(const std::string& path)
+{
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 ? u64(info.st_mtime) : 0;
+}
+
+static bool ReadFileContents(const std::string& path, std::string& contents)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if(!file)
+		return false;
+
+	contents.clear();
+	char buffer[4096];
+	size_t read;
+	while((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		contents.append(buffer, read);
+	bool success = !ferror(file);
+	fclose(file);
+	return success;
+}
+
+// Watches the shader files, and reads a file's source once it has stopped changing. Uses inotify on Linux, and
+// polls file modification times elsewhere. Never touches OpenGL, so compiling is left to the main thread.
+static void ShaderWatcherWorker()
+{
+	typedef std::chrono::steady_clock Clock;
+	std::vector<u64> modified_times;
+	std::vector<bool> changed;
+	std::vector<Clock::time_point> reload_times;
+
+	#ifdef __linux__
+	// Directories are watched rather than files, since many editors save by replacing the file.
+	int inotify = inotify_init1(IN_NONBLOCK);
+	std::vector<int> watches;
+	#endif
+
+	for(;;)
+	{
+		std::vector<std::string> paths;
+		{
+			std::unique_lock<std::mutex> lock(g_shader_watcher.mutex);
+			g_shader_watcher.wake.wait_for(lock, std::chrono::milliseconds(SHADER_WATCH_INTERVAL_MS), [] { return g_shader_watcher.quitting; });
+			if(g_shader_watcher.quitting)
+				break;
+			paths = g_shader_watcher.paths;
+		}
+
+		// Start watching any newly loaded shaders.
+		u32 watched = u32(changed.size());
+		changed.resize(paths.size(), false);
+		reload_times.resize(paths.size());
+		modified_times.resize(paths.size(), 0);
+		for(u32 i = watched; i < paths.size(); ++i)
+			modified_times[i] = GetFileModifiedTime(paths[i]);
+
+		Clock::time_point now = Clock::now();
+		Clock::time_point reload_time = now + std::chrono::milliseconds(SHADER_RELOAD_DELAY_MS);
+
+		#ifdef __linux__
+		if(inotify >= 0)
+		{
+			watches.resize(paths.size(), -1);
+			for(u32 i = watched; i < paths.size(); ++i)
+			{
+				if(paths[i].empty())
+					continue;
+				size_t slash = paths[i].find_last_of('/');
+				std::string dir = slash == std::string::npos ? "." : paths[i].substr(0, slash + 1);
+				watches[i] = inotify_add_watch(inotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+			}
+
+			alignas(inotify_event) char buffer[4096];
+			ssize_t length;
+			while((length = read(inotify, buffer, sizeof(buffer))) > 0)
+			{
+				for(char* ptr = buffer; ptr < buffer + length; ptr += sizeof(inotify_event) + ((inotify_event*)ptr)->len)
+				{
+					const inotify_event* event = (const inotify_event*)ptr;
+					if(event->len == 0)
+						continue;
+
+					for(u32 i = 0; i < paths.size(); ++i)
+					{
+						size_t slash = paths[i].find_last_of('/');
+						const char* name = paths[i].c_str() + (slash == std::string::npos ? 0 : slash + 1);
+						if(watches[i] == event->wd && strcmp(name, event->name) == 0)
+						{
+							changed[i] = true;
+							reload_times[i] = reload_time;
+						}
+					}
+				}
+			}
+		}
+		else
+		#endif
+		{
+			for(u32 i = 0; i < paths.size(); ++i)
+			{
+				if(paths[i].empty())
+					continue;
+				u64 modified_time = GetFileModifiedTime(paths[i]);
+				if(modified_time != modified_times[i])
+				{
+					modified_times[i] = modified_time;
+					changed[i] = true;
+					reload_times[i] = reload_time;
+				}
+			}
+		}
+
+		// Read the new source of files that have settled.
+		for(u32 i = 0; i < paths.size(); ++i)
+		{
+			if(!changed[i] || now < reload_times[i])
+				continue;
+			changed[i] = false;
+
+			ShaderReload reload;
+			reload.shader = ShaderId(i);
+			if(!ReadFileContents(paths[i], reload.source))
+				continue;
+
+			std::lock_guard<std::mutex> lock(g_shader_watcher.mutex);
+			std::vector<ShaderReload>& reloads = g_shader_watcher.reloads;
+			auto existing = std::find_if(reloads.begin(), reloads.end(), [&](const ShaderReload& r) { return r.shader == reload.shader; });
+			if(existing != reloads.end())
+				existing->source.swap(reload.source);
+			else
+				reloads.push_back(reload);
+		}
+	}
+
+	#ifdef __linux__
+	if(inotify >= 0)
+		close(inotify);
+	#endif
+}
+
+// Compiles any reloaded shader source, swapping it in if it compiled and keeping the old program otherwise.
+static void ProcessShaderReloads()
+{
+	if(!g_shader_hot_reload)
+		return;
+
+	std::vector<ShaderReload> reloads;
+	{
+		std::lock_guard<std::mutex> lock(g_shader_watcher.mutex);
+		reloads.swap(g_shader_watcher.reloads);
+	}
+
+	for(const ShaderReload& reload : reloads)
+	{
+		ShaderId shader = reload.shader;
+		sf::Shader& spare = g_shaders[shader][1 - g_shader_active[shader]];
+		if(!spare.loadFromMemory(reload.source, sf::Shader::Fragment))
+		{
+			printf("[ERR]: Couldn't reload shader %s, keeping the previous version\n", g_shader_watcher.paths[shader].c_str());
+			continue;
+		}
+		g_shader_active[shader] = 1 - g_shader_active[shader];
+
+		// The new program starts with default uniforms, so upload all the cached values again. Unset uniforms keep the shader's defaults.
+		for(u32 i = 0; i < g_shader_uniform_counts[shader]; ++i)
+		{
+			g_shader_uniforms[shader][i].dirty = g_shader_uniforms[shader][i].type != UniformType::None;
+			g_shader_uniforms[shader][i].bound_texture = nullptr;
+		}
+	}
+}
+
+void SetShaderHotReload(bool b)
+{
+	g_shader_hot_reload = b;
+
+	// The watcher keeps running once started, so that edits made while disabled are picked up when re-enabled.
+	if(b && !g_shader_watcher.thread.joinable())
+		g_shader_watcher.thread = std::thread(ShaderWatcherWorker);
+}
+
+// Returns one of a level's targets, (re)creating it at 1/2^level of the frame size if necessary.
+static sf::RenderTexture& GetDownsampleTarget(sf::RenderTexture (&targets)[MAX_DOWNSAMPLE_LEVELS][2], u32 level, u32 which)
+{
+	sf::Vector2u frame_size = g_scene_targets[0].getSize();
+	u32 width = max(frame_size.x >> level, 1u);
+	u32 height = max(frame_size.y >> level, 1u);
+
+	sf::RenderTexture& target = targets[level - 1][which];
+	if(target.getSize().x != width || target.getSize().y != height)
+	{
+		target.create(width, height);
+		target.setSmooth(true);
+	}
+	return target;
+}
+
+// Draws a texture stretched over the whole of the target, optionally through a shader.
+static void Resample(const sf::Texture& src, sf::RenderTexture& dst, const sf::Shader* shader = nullptr)
+{
+	sf::Sprite sprite(src);
+	sprite.setScale(float(dst.getSize().x) / src.getSize().x, float(dst.getSize().y) / src.getSize().y);
+	dst.setView(dst.getDefaultView());
+	dst.draw(sprite, sf::RenderStates(sf::BlendNone, sf::Transform::Identity, nullptr, shader));
+	dst.display();
+	CountDrawCall(4, &src, shader);
+}
+
+// Repeatedly halves and Gaussian blurs the frame, returning the blurred frame at 1/2^levels resolution.
+static const sf::Texture* BuildGaussianMipChain(const sf::Texture& frame, u32 levels)
+{
+	if(!g_blur_shader_loaded)
+	{
+		g_blur_shader_loaded = true;
+		if(!g_blur_shader.loadFromMemory(BLUR_SHADER_SOURCE, sf::Shader::Fragment))
+			printf("[ERR]: Could not load the blur shader!\n");
+	}
+	g_blur_shader.setParameter("texture", sf::Shader::CurrentTexture);
+
+	// Each level is downsampled from the (already blurred) level above, then blurred horizontally and vertically.
+	const sf::Texture* input = &frame;
+	for(u32 level = 1; level <= levels; ++level)
+	{
+		sf::RenderTexture& mip = GetDownsampleTarget(g_blur_targets, level, 0);
+		sf::RenderTexture& scratch = GetDownsampleTarget(g_blur_targets, level, 1);
+		Resample(*input, mip);
+		g_blur_shader.setParameter("direction", 1.0f / mip.getSize().x, 0.0f);
+		Resample(mip.getTexture(), scratch, &g_blur_shader);
+		g_blur_shader.setParameter("direction", 0.0f, 1.0f / mip.getSize().y);
+		Resample(scratch.getTexture(), mip, &g_blur_shader);
+		input = &mip.getTexture();
+	}
+	return input;
+}
+
+// Uploads the shader's changed uniforms, just before it is used.
+static void UploadShaderUniforms(ShaderId shader)
+{
+	sf::Shader& sfshader = g_shaders[shader][g_shader_active[shader]];
+	for(u32 i = 0; i < g_shader_uniform_counts[shader]; ++i)
+	{
+		UniformSlot& slot = g_shader_uniforms[shader][i];
+		if(slot.type == UniformType::Texture)
+		{
+			const sf::Texture* source = g_texture_sources[slot.texture];
+			if(slot.dirty || slot.bound_texture != source)
+			{
+				sfshader.setParameter(slot.name, *source);
+				slot.bound_texture = source;
+			}
+			slot.dirty = false;
+			continue;
+		}
+
+		if(!slot.dirty || slot.type == UniformType::None)
+			continue;
+
+		const float* v = slot.values;
+		switch(slot.type)
+		{
+			case UniformType::Float:	sfshader.setParameter(slot.name, v[0]); break;
+			case UniformType::Vec2:		sfshader.setParameter(slot.name, v[0], v[1]); break;
+			case UniformType::Vec3:		sfshader.setParameter(slot.name, v[0], v[1], v[2]); break;
+			case UniformType::Vec4:		sfshader.setParameter(slot.name, v[0], v[1], v[2], v[3]); break;
+			case UniformType::Matrix:	sfshader.setParameter(slot.name, sf::Transform(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8])); break;
+			default: break;
+		}
+		slot.dirty = false;
+	}
+}
+
+// Runs a shader over the whole frame so far.
+static void ApplyPostEffect(ShaderId shader)
+{
+	FlushBatch();
+	UploadShaderUniforms(shader);
+	sf::Shader& post_shader = g_shaders[shader][g_shader_active[shader]];
+	post_shader.setParameter("texture", sf::Shader::CurrentTexture);
+
+	if(g_scene_offscreen)
+	{
+		// Draw the current scene target into the other one, which then becomes the scene target.
+		sf::RenderTexture& src = g_scene_targets[g_scene_target];
+		sf::RenderTexture& dst = g_scene_targets[1 - g_scene_target];
+		src.display();
+		sf::View view = src.getView();
+
+		if(!g_shader_blur_inputs[shader].empty())
+			post_shader.setParameter(g_shader_blur_inputs[shader], *BuildGaussianMipChain(src.getTexture(), g_shader_blur_levels[shader]));
+
+		u32 downsample = g_shader_downsample[shader];
+		if(downsample == 0)
+		{
+			Resample(src.getTexture(), dst, &post_shader);
+		}
+		else
+		{
+			// Halve the frame down to the shader's resolution, run it there, then stretch the result back up.
+			const sf::Texture* input = &src.getTexture();
+			for(u32 level = 1; level <= downsample; ++level)
+			{
+				sf::RenderTexture& mip = GetDownsampleTarget(g_downsample_targets, level, 0);
+				Resample(*input, mip);
+				input = &mip.getTexture();
+			}
+			sf::RenderTexture& output = GetDownsampleTarget(g_downsample_targets, downsample, 1);
+			Resample(*input, output, &post_shader);
+			Resample(output.getTexture(), dst);
+		}
+		dst.setView(view);
+
+		g_scene_target = 1 - g_scene_target;
+		g_target = &dst;
+	}
+	else
+	{
+		// Copy the window contents, and draw them back over the whole window.
+		g_postprocess_texture.update(g_window);
+		++g_render_stats.post_effect_copies;
+
+		sf::View view = g_window.getView();
+		g_window.setView(g_window.getDefaultView());
+		g_window.draw(sf::Sprite(g_postprocess_texture), &post_shader);
+		CountDrawCall(4, &g_postprocess_texture, &post_shader);
+		g_window.setView(view);
+	}
+}
+
+// Applies the post effect chain, and displays the finished frame.
+static void PresentFrame()
+{
+	FlushBatch();
+	for(u32 i = 0; i < g_post_effect_chain_length; ++i)
+		ApplyPostEffect(g_post_effect_chain[i]);
+
+	if(g_scene_offscreen)
+	{
+		sf::RenderTexture& scene = g_scene_targets[g_scene_target];
+		scene.display();
+		if(!g_window_headless)
+		{
+			g_window.setView(g_window.getDefaultView());
+			g_window.draw(sf::Sprite(scene.getTexture()), sf::BlendNone);
+			CountDrawCall(4, &scene.getTexture(), nullptr);
+		}
+	}
+
+	// Save the frame out if it was requested. Windows are captured before display(), as the back buffer is undefined
+	// after the swap.
+	if(g_capture_frame == g_frame_num && !g_capture_path.empty())
+	{
+		sf::Image frame = g_scene_offscreen ? g_scene_targets[g_scene_target].getTexture().copyToImage() : g_window.capture();
+		if(!frame.saveToFile(g_capture_path))
+			printf("[ERR]: Couldn't save frame %llu to %s\n", (unsigned long long)g_frame_num, g_capture_path.c_str());
+		g_capture_path.clear();
+	}
+
+	if(!g_window_headless)
+		g_window.display();
+}
+
+void DrawPostEffects(ShaderId shader)
+{
+	PROFILE_SCOPE("DrawPostEffects");
+
+	if (shader >= g_total_shaders)
+	{
+		printf("[ERR]: Invalid shader ID. Perhaps shaders aren't available?\n");
+		return;
+	}
+
+	ApplyPostEffect(shader);
+}
+
+void SetPostEffectChain(const ShaderId* shaders, u32 count)
+{
+	g_post_effect_chain_length = 0;
+	for(u32 i = 0; i < count && g_post_effect_chain_length < MAX_SHADERS; ++i)
+	{
+		if(shaders[i] >= g_total_shaders)
+		{
+			printf("[ERR]: Invalid shader ID in post effect chain.\n");
+			continue;
+		}
+		g_post_effect_chain[g_post_effect_chain_length++] = shaders[i];
+	}
+}
+
+void SetShaderResolutionScale(ShaderId shader, float scale)
+{
+	if(shader >= g_total_shaders)
+	{
+		printf("[ERR]: Invalid shader ID. Perhaps shaders aren't available?\n");
+		return;
+	}
+
+	// Round to the nearest power of two.
+	float halvings = float(-log(clamp(scale, 0.0f, 1.0f)) / log(2.0));
+	g_shader_downsample[shader] = u32(min(halvings + 0.5f, float(MAX_DOWNSAMPLE_LEVELS)));
+}
+
+void SetShaderBlurInput(ShaderId shader, const char* name, u32 levels)
+{
+	if(shader >= g_total_shaders)
+	{
+		printf("[ERR]: Invalid shader ID. Perhaps shaders aren't available?\n");
+		return;
+	}
+
+	g_shader_blur_inputs[shader] = name ? name : "";
+	g_shader_blur_levels[shader] = clamp(levels, 1u, u32(MAX_DOWNSAMPLE_LEVELS));
+}
+
+void SetShaderParameter(ShaderId shader, const char* name, float val)
+{
+	SetShaderUniform(GetShaderUniform(shader, name), val);
+}
+
+ShaderUniformId GetShaderUniform(ShaderId shader, const char* name)
+{
+	if(shader >= g_total_shaders)
+	{
+		printf("[ERR]: Invalid shader ID. Perhaps shaders aren't available?\n");
+		return NO_SHADER_UNIFORM;
+	}
+
+	u32 count = g_shader_uniform_counts[shader];
+	for(u32 i = 0; i < count; ++i)
+	{
+		if(g_shader_uniforms[shader][i].name == name)
+			return (u32(shader) << 16) | i;
+	}
+
+	if(count == MAX_SHADER_UNIFORMS)
+	{
+		printf("[ERR]: Too many uniforms on shader %u, couldn't add %s\n", u32(shader), name);
+		return NO_SHADER_UNIFORM;
+	}
+
+	UniformSlot& slot = g_shader_uniforms[shader][count];
+	slot.name = name;
+	slot.type = UniformType::None;
+	slot.dirty = false;
+	slot.bound_texture = nullptr;
+	g_shader_uniform_counts[shader] = count + 1;
+	return (u32(shader) << 16) | count;
+}
+
+// Returns the slot for a uniform handle, or null if it's invalid.
+static UniformSlot* GetUniformSlot(ShaderUniformId uniform)
+{
+	u32 shader = uniform >> 16;
+	u32 index = uniform & 0xFFFF;
+	if(shader >= g_total_shaders || index >= g_shader_uniform_counts[shader])
+	{
+		printf("[ERR]: Invalid shader uniform.\n");
+		return nullptr;
+	}
+	return &g_shader_uniforms[shader][index];
+}
+
+// Stores a uniform value, only marking it for upload if it has changed.
+static void SetUniformValues(ShaderUniformId uniform, UniformType type, const float* values, u32 count)
+{
+	UniformSlot* slot = GetUniformSlot(uniform);
+	if(!slot)
+		return;
+
+	if(slot->type == type && memcmp(slot->values, values, count * sizeof(float)) == 0)
+		return;
+
+	slot->type = type;
+	memcpy(slot->values, values, count * sizeof(float));
+	slot->dirty = true;
+}
+
+void SetShaderUniform(ShaderUniformId uniform, float val)
+{
+	SetUniformValues(uniform, UniformType::Float, &val, 1);
+}
+
+void SetShaderUniform(ShaderUniformId uniform, f2 val)
+{
+	float values[] = { val.x, val.y };
+	SetUniformValues(uniform, UniformType::Vec2, values, 2);
+}
+
+void SetShaderUniform(ShaderUniformId uniform, f3 val)
+{
+	float values[] = { val.x, val.y, val.z };
+	SetUniformValues(uniform, UniformType::Vec3, values, 3);
+}
+
+void SetShaderUniform(ShaderUniformId uniform, f4 val)
+{
+	float values[] = { val.x, val.y, val.z, val.w };
+	SetUniformValues(uniform, UniformType::Vec4, values, 4);
+}
+
+void SetShaderUniformMatrix(ShaderUniformId uniform, const float* mat)
+{
+	SetUniformValues(uniform, UniformType::Matrix, mat, 9);
+}
+
+void SetShaderUniformTexture(ShaderUniformId uniform, TextureId texture)
+{
+	if(texture >= g_total_textures)
+	{
+		printf("[ERR]: Invalid texture ID.\n");
+		return;
+	}
+
+	UniformSlot* slot = GetUniformSlot(uniform);
+	if(!slot || (slot->type == UniformType::Texture && slot->texture == texture))
+		return;
+
+	slot->type = UniformType::Texture;
+	slot->texture = texture;
+	slot->dirty = true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Sound API
+//////////////////////////////////////////////////////////////////////////
+
+SoundId LoadSound(const char* path)
+{
+	if(g_total_sounds < MAX_SOUNDS)
+	{
+		g_sound_buffers[g_total_sounds].reset(new sf::SoundBuffer);
+		const u8* data;
+		u32 size;
+		if(FindPackedAsset(path, data, size) ? g_sound_buffers[g_total_sounds]->loadFromMemory(data, size)
+											 : g_sound_buffers[g_total_sounds]->loadFromFile(path))
+		{
+			return g_total_sounds++;
+		}
+
+		g_sound_buffers[g_total_sounds].reset();
+		printf("[ERR]: Couldn't load sound file from %s\n", path);
+		return -1;
+	}
+
+	printf("[ERR]: No remaining sound memory!\n");
+	return -1;
+}
+
+SoundId LoadSoundAsync(const char* path)
+{
+	if(g_total_sounds < MAX_SOUNDS)
+	{
+		// Sounds are silent until loaded.
+		SoundId id = SoundId(g_total_sounds++);
+		g_sound_buffers[id].reset(new sf::SoundBuffer);
+		g_sound_pending[id] = true;
+		QueueAsyncLoad(AsyncLoadType::Sound, id, path);
+		return id;
+	}
+
+	printf("[ERR]: No remaining sound memory!\n");
+	return -1;
+}
+
+// Frees the least recently played decoded bank sounds until within budget. Sounds still playing are kept, as is the
+// most recently played sound, which is about to be.
+static void EvictBankSounds()
+{
+	if(g_decoded_bank_sounds.empty())
+		return;
+
+	auto it = std::prev(g_decoded_bank_sounds.end());
+	while(g_decoded_bank_bytes > g_sound_bank_budget && it != g_decoded_bank_sounds.begin())
+	{
+		auto prev = std::prev(it);
+		SoundId sound = *it;
+		if(g_sound_voice_counts[sound] == 0)
+		{
+			g_decoded_bank_bytes -= g_sound_decoded_bytes[sound];
+			g_sound_buffers[sound].reset();
+			g_decoded_bank_sounds.erase(it);
+		}
+		it = prev;
+	}
+}
+
+// Decodes a bank sound straight from its mapped bank, if it isn't already decoded, and marks it as most recently played.
+static bool DecodeBankSound(SoundId sound)
+{
+	if(g_sound_buffers[sound])
+	{
+		g_decoded_bank_sounds.splice(g_decoded_bank_sounds.begin(), g_decoded_bank_sounds, g_decoded_bank_sound_entries[sound]);
+		return true;
+	}
+
+	std::unique_ptr<sf::SoundBuffer> buffer(new sf::SoundBuffer);
+	if(!buffer->loadFromMemory(g_sound_bank_files[sound], g_sound_bank_file_sizes[sound]))
+	{
+		printf("[ERR]: Couldn't decode sound %u from its sound bank\n", sound);
+		return false;
+	}
+
+	g_sound_decoded_bytes[sound] = u32(buffer->getSampleCount() * sizeof(sf::Int16));
+	g_decoded_bank_bytes += g_sound_decoded_bytes[sound];
+	g_sound_buffers[sound] = std::move(buffer);
+	g_decoded_bank_sounds.push_front(sound);
+	g_decoded_bank_sound_entries[sound] = g_decoded_bank_sounds.begin();
+	EvictBankSounds();
+	return true;
+}
+
+SoundId LoadSoundBank(const char* path)
+{
+	if(g_total_sound_banks >= MAX_SOUND_BANKS)
+	{
+		printf("[ERR]: No remaining sound bank memory!\n");
+		return -1;
+	}
+
+	MappedFile& bank = g_sound_banks[g_total_sound_banks];
+	if(!bank.open(path))
+	{
+		printf("[ERR]: Couldn't open sound bank %s\n", path);
+		return -1;
+	}
+
+	// Check the header and index, so bad banks are caught here rather than on first play.
+	SoundBankHeader header = {};
+	if(bank.size >= sizeof(header))
+		memcpy(&header, bank.data, sizeof(header));
+	u64 index_end = sizeof(header) + u64(header.sound_count) * sizeof(SoundBankEntry);
+	bool valid = header.magic == SOUND_BANK_MAGIC && header.version == SOUND_BANK_VERSION && index_end <= bank.size;
+	for(u32 i = 0; valid && i < header.sound_count; ++i)
+	{
+		SoundBankEntry entry;
+		memcpy(&entry, bank.data + sizeof(header) + i * sizeof(entry), sizeof(entry));
+		valid = u64(entry.offset) + entry.size <= bank.size;
+	}
+	if(!valid)
+	{
+		printf("[ERR]: %s isn't a valid sound bank\n", path);
+		bank.close();
+		return -1;
+	}
+	if(header.sound_count == 0)
+	{
+		printf("[ERR]: Sound bank %s is empty\n", path);
+		bank.close();
+		return -1;
+	}
+	if(header.sound_count > u32(MAX_SOUNDS - g_total_sounds))
+	{
+		printf("[ERR]: No remaining sound memory!\n");
+		bank.close();
+		return -1;
+	}
+
+	// Registering a sound just records where it is. It's decoded when it's first played.
+	SoundId first = SoundId(g_total_sounds);
+	for(u32 i = 0; i < header.sound_count; ++i)
+	{
+		SoundBankEntry entry;
+		memcpy(&entry, bank.data + sizeof(header) + i * sizeof(entry), sizeof(entry));
+		g_sound_bank_files[g_total_sounds] = bank.data + entry.offset;
+		g_sound_bank_file_sizes[g_total_sounds] = entry.size;
+		++g_total_sounds;
+	}
+	++g_total_sound_banks;
+	return first;
+}
+
+bool BuildSoundBank(const char* bank_path, const char* const* sound_paths, u32 count)
+{
+	std::vector<std::string> files(count);
+	SoundBankHeader header = { SOUND_BANK_MAGIC, SOUND_BANK_VERSION, count };
+	std::vector<SoundBankEntry> entries(count);
+	u64 offset = sizeof(header) + u64(count) * sizeof(SoundBankEntry);
+	for(u32 i = 0; i < count; ++i)
 	{
-		if (g_fonts[g_total_fonts].loadFromFile(path))
+		// Make sure SFML can decode the file now, rather than finding out when it's played.
+		sf::InputSoundFile decoder;
+		if(!ReadFileContents(sound_paths[i], files[i]) || !decoder.openFromMemory(files[i].data(), files[i].size()))
 		{
-			return g_total_fonts++;
+			printf("[ERR]: Couldn't load sound file from %s\n", sound_paths[i]);
+			return false;
 		}
 
-		printf("[ERR]: Could not load font from %s\n", path);
-		return -1;
+		entries[i].offset = u32(offset);
+		entries[i].size = u32(files[i].size());
+		offset += files[i].size();
+	}
+	if(offset > u32(-1))
+	{
+		printf("[ERR]: Sound bank %s would be over 4GB!\n", bank_path);
+		return false;
 	}
 
-	printf("[ERR]: Out of font memory!\n");
-	return -1;
-}
-
-void PushFontStyle()
-{
-	if(g_font_stack_size == MAX_FONT_STACK_SIZE - 1)
+	FILE* bank = fopen(bank_path, "wb");
+	if(!bank)
 	{
-		printf("[ERR]: Font style stack is too big to push onto. Did you forget to pop?\n");
-		return;
+		printf("[ERR]: Couldn't write sound bank %s\n", bank_path);
+		return false;
 	}
 
-	u32 copy_from = g_font_stack_size;
-	g_font_stack_size += 1;
-	g_font_stack[g_font_stack_size] = g_font_stack[copy_from];
+	bool success = fwrite(&header, sizeof(header), 1, bank) == 1;
+	if(count > 0)
+		success = success && fwrite(&entries[0], sizeof(SoundBankEntry), count, bank) == count;
+	for(const std::string& file : files)
+		success = success && fwrite(file.data(), 1, file.size(), bank) == file.size();
+	success = fclose(bank) == 0 && success;
+	if(!success)
+		printf("[ERR]: Couldn't write sound bank %s\n", bank_path);
+	return success;
 }
 
-void PopFontStyle()
+void SetSoundBankBudget(u32 bytes)
 {
-	if(g_font_stack_size == 0)
+	g_sound_bank_budget = bytes;
+	EvictBankSounds();
+}
+
+// Creates the voices, all free, and starts the software mixer if it's in use. The software mixer must be stopped, so
+// nothing else is touching the voices.
+static void InitVoices()
+{
+	g_voices.clear();
+	if(g_sound_mixer == SoundMixer::OpenAL)
+		g_voices.resize(g_voice_count);
+
+	g_voice_free_head = NO_FREE_VOICE;
+	for(u32 i = g_voice_count; i-- > 0;)
 	{
-		printf("[ERR]: Font style stack is already empty.\n");
-		return;
+		g_voice_sounds[i] = NO_SOUND;
+		g_voice_next_free[i] = g_voice_free_head;
+		g_voice_free_head = u16(i);
 	}
+	g_voices_ready = true;
 
-	g_font_stack_size -= 1;
+	if(g_sound_mixer == SoundMixer::Software)
+		g_mixer_stream.start();
 }
 
-static FontState& GetFontState()
+// Returns a voice to the free list, invalidating any instance IDs for it.
+static void ReleaseVoice(u32 idx)
 {
-	return g_font_stack[g_font_stack_size];
+	--g_sound_voice_counts[g_voice_sounds[idx]];
+	g_voice_sounds[idx] = NO_SOUND;
+	++g_voice_generations[idx];
+	g_voice_next_free[idx] = g_voice_free_head;
+	g_voice_free_head = u16(idx);
 }
 
-void SetFont(FontId font)
+// Sets a voice's output level from its volume, bus and pan.
+static void ApplyVoiceGain(u32 idx)
 {
-	if (font < g_total_fonts)
+	float volume = g_voice_volumes[idx] * g_bus_gains[u32(g_voice_buses[idx])];
+	float gain = volume * volume;
+	if(g_sound_mixer == SoundMixer::OpenAL)
 	{
-		GetFontState().font = font;
+		g_voices[idx].setVolume(gain * 100.0f);
+		return;
 	}
+
+	float pan = g_voice_pans[idx];
+	g_voice_gains[idx][0] = gain * min(1 - pan, 1.0f);
+	g_voice_gains[idx][1] = gain * min(1 + pan, 1.0f);
 }
 
-void SetFontSize(u32 size)
+static void ApplyVoicePan(u32 idx)
 {
-	GetFontState().size = size;
+	if(g_sound_mixer != SoundMixer::OpenAL)
+	{
+		ApplyVoiceGain(idx);
+		return;
+	}
+
+	// OpenAL has no panning as such, so place the sound on a half circle in front of the listener.
+	float pan = g_voice_pans[idx];
+	g_voices[idx].setRelativeToListener(true);
+	g_voices[idx].setPosition(pan, 0, -sqrt(1 - pan * pan));
 }
 
-void SetFontColour(f4 col)
+static void StartVoice(u32 idx, float pitch, bool loop)
 {
-	GetFontState().col = col;
+	const sf::SoundBuffer& buffer = *g_sound_buffers[g_voice_sounds[idx]];
+	if(g_sound_mixer != SoundMixer::OpenAL)
+	{
+		g_voice_positions[idx] = 0;
+		g_voice_steps[idx] = double(buffer.getSampleRate()) / MIXER_SAMPLE_RATE * pitch;
+		g_voice_loops[idx] = loop;
+		g_voice_finished[idx] = false;
+		ApplyVoiceGain(idx);
+		return;
+	}
+
+	sf::Sound& voice = g_voices[idx];
+	voice.setBuffer(buffer);
+	voice.setPitch(pitch);
+	voice.setLoop(loop);
+	ApplyVoicePan(idx);
+	ApplyVoiceGain(idx);
+	voice.play();
 }
 
-void SetFontScale(float scale)
+static void StopVoice(u32 idx)
 {
-	GetFontState().scale = scale;
+	if(g_sound_mixer == SoundMixer::OpenAL)
+		g_voices[idx].stop();
+	ReleaseVoice(idx);
 }
 
-void DrawText(const char* text, f2 pos, TextAlign align)
+static bool IsVoiceFinished(u32 idx)
 {
-	FontState& font_state = GetFontState();
-	DrawText(text, font_state.font, pos, font_state.size, font_state.col, align, font_state.scale);
+	if(g_sound_mixer == SoundMixer::OpenAL)
+		return g_voices[idx].getStatus() == sf::SoundSource::Stopped;
+	return g_voice_finished[idx];
 }
 
-void DrawText(const char* text, FontId font, f2 pos, u32 size_px, f4 col, TextAlign align, float scale)
+static void StopAllVoices()
 {
-	if(g_total_fonts == 0)
+	if(!g_voices_ready)
 		return;
 
-	if(font >= g_total_fonts)
-	{
-		printf("Font ID is not valid!\n");
-		return;
-	}
-
-	sf::Text text_params;
-	text_params.setFont(g_fonts[font]);
-	text_params.setCharacterSize(size_px);
-	text_params.setColor(Col(col));
-	text_params.setString(text);
-	text_params.setPosition(sf::Vector2f(pos.x, pos.y));
-	text_params.setScale(sf::Vector2f(scale, scale));
-
-	if (align == TextAlign::Centre)
+	for(u32 i = 0; i < g_voice_count; ++i)
 	{
-		sf::FloatRect rect = text_params.getLocalBounds();
-		text_params.setOrigin(sf::Vector2f(rect.width * 0.5f, rect.height * 0.5f));
+		if(g_voice_sounds[i] != NO_SOUND)
+			StopVoice(i);
 	}
-
-	g_window.draw(text_params);
 }
 
-//////////////////////////////////////////////////////////////////////////
-// Graphics API
-//////////////////////////////////////////////////////////////////////////
-
-void DrawQuad(f2 pos, f2 size, f4 col, QuadAlign align)
+// Stops every sound and the software mixer, so the voices can be recreated.
+static void ResetVoices()
 {
-	sf::Vector2f p(pos.x, pos.y);
-	if(align == QuadAlign::Centre)
 	{
-		p.x -= size.x * 0.5f;
-		p.y -= size.y * 0.5f;
+		std::lock_guard<std::mutex> lock(g_mixer_mutex);
+		StopAllVoices();
+		g_voices_ready = false;
 	}
-
-	sf::RectangleShape r;
-	r.setPosition(p);
-	r.setSize(sf::Vector2f(size.x, size.y));
-	r.setFillColor(Col(col));
-	g_window.draw(r);
+	g_mixer_stream.stop();
+	g_voices.clear();
 }
 
-void DrawQuad(f2 startpos, f2 endpos, float width, f4 col)
+// Releases the voices of finished sounds, so PlaySound() never has to ask OpenAL which voices are free.
+static void RefreshVoices()
 {
-	sf::RectangleShape r;
-	float height = length(endpos-startpos);
-	f2 dir = (endpos-startpos)/height;
-	float ang = float(atan2(dir.y, dir.x) - atan2(1, 0));
-	r.setOrigin(width*0.5f, 0);
-	r.setPosition(sf::Vector2f(startpos.x, startpos.y));
-	r.setSize(sf::Vector2f(width, height));
-	r.setRotation(float(ang*RAD_TO_DEG));
-	r.setFillColor(Col(col));
-	g_window.draw(r);
-}
+	if(!g_voices_ready)
+		return;
 
-void DrawCircle(f2 pos, float radius, f4 col)
-{
-	sf::CircleShape c;
-	c.setRadius(radius);
-	c.setPosition(sf::Vector2f(pos.x, pos.y));
-	c.setOrigin(sf::Vector2f(radius, radius));
-	c.setFillColor(Col(col));
-	g_window.draw(c);
+	std::lock_guard<std::mutex> lock(g_mixer_mutex);
+	for(u32 i = 0; i < g_voice_count; ++i)
+	{
+		if(g_voice_sounds[i] != NO_SOUND && IsVoiceFinished(i))
+			ReleaseVoice(i);
+	}
 }
 
-TextureId LoadTexture(const char* path)
+// Picks a playing voice to make way for the given sound: the oldest voice playing that sound if it's at its voice
+// limit, otherwise the oldest voice of the lowest priority, as long as that isn't higher than the sound's own.
+// Returns MAX_VOICES if there's nothing it's allowed to replace.
+static u32 FindVoiceToSteal(SoundId sound, bool at_limit)
 {
-	if(g_total_textures < MAX_TEXTURES)
+	u8 priority = g_sound_priorities[sound];
+	u32 best = MAX_VOICES;
+	u8 best_priority = 0;
+	for(u32 i = 0; i < g_voice_count; ++i)
 	{
-		if(g_textures[g_total_textures].loadFromFile(path))
+		SoundId other = g_voice_sounds[i];
+		if(other == NO_SOUND || (at_limit && other != sound) || g_sound_priorities[other] > priority)
+			continue;
+
+		u8 other_priority = g_sound_priorities[other];
+		if(best == MAX_VOICES || other_priority < best_priority
+			|| (other_priority == best_priority && g_voice_play_orders[i] < g_voice_play_orders[best]))
 		{
-			g_textures[g_total_textures].setSmooth(true);
-			return g_total_textures++;
+			best = i;
+			best_priority = other_priority;
 		}
-
-		printf("[ERR]: Couldn't load texture file from %s\n", path);
-		return -1;
 	}
-
-	printf("[ERR]: No remaining texture memory!\n");
-	return -1;
+	return best;
 }
 
-SpriteId CreateSprite(TextureId texture_id, SpriteOrigin origin)
+// Returns the voice index for a sound instance ID, or MAX_VOICES if the ID is invalid, or its sound has since finished.
+static u32 GetVoiceIndex(SoundInstanceId sound_instance)
 {
-	if(texture_id >= g_total_textures)
+	u32 idx = sound_instance & VOICE_INDEX_MASK;
+	if(idx >= g_voice_count)
 	{
-		printf("[ERR]: Invalid texture ID!\n");
-		return -1;
+		printf("[ERR]: Invalid sound instance ID.\n");
+		return MAX_VOICES;
 	}
+	if(!g_voices_ready || g_voice_generations[idx] != (sound_instance >> VOICE_INDEX_BITS) || g_voice_sounds[idx] == NO_SOUND)
+		return MAX_VOICES;
+	return idx;
+}
+
+// Adds the software mixed voices into a buffer of interleaved stereo samples. Called with g_mixer_mutex held.
+static void MixVoices(float* out, u32 frames)
+{
+	memset(out, 0, frames * 2 * sizeof(float));
+	if(!g_voices_ready)
+		return;
 
-	u32 idx = 0;
-	for (; idx < MAX_SPRITES; ++idx)
+	for(u32 i = 0; i < g_voice_count; ++i)
 	{
-		if (!g_sprites[idx].getTexture())
-			break;
-		
-		if(idx == MAX_SPRITES - 1)
+		SoundId sound = g_voice_sounds[i];
+		if(sound == NO_SOUND || g_voice_finished[i])
+			continue;
+
+		const sf::SoundBuffer& buffer = *g_sound_buffers[sound];
+		const sf::Int16* samples = buffer.getSamples();
+		u32 channels = buffer.getChannelCount();
+		u64 length = channels ? buffer.getSampleCount() / channels : 0;
+		if(length == 0)
 		{
-			printf("[ERR]: Out of sprite memory!\n");
-			return -1;
+			g_voice_finished[i] = true;
+			continue;
 		}
-	}
 
-	sf::Sprite& sprite = g_sprites[idx];
-	sprite.setTexture(g_textures[texture_id]);
+		// Mono sounds are mixed into both sides.
+		u32 right_channel = channels > 1 ? 1 : 0;
+		float left_gain = g_voice_gains[i][0] / 32768.0f;
+		float right_gain = g_voice_gains[i][1] / 32768.0f;
+		double pos = g_voice_positions[i];
+		double step = g_voice_steps[i];
 
-	if(origin == SpriteOrigin::Centre)
-	{
-		sf::Vector2u size = g_textures[texture_id].getSize();
-		sprite.setOrigin(sf::Vector2f(size.x * 0.5f, size.y * 0.5f));
+		if(step == 1 && pos == floor(pos))
+		{
+			// Sounds at the mixer's own rate are a straight multiply-add, which the compiler can vectorise.
+			u64 p = u64(pos);
+			for(u32 done = 0; done < frames;)
+			{
+				u32 count = u32(min(u64(frames - done), length - p));
+				const sf::Int16* src = samples + p * channels;
+				float* dst = out + done * 2;
+				if(channels == 1)
+				{
+					for(u32 k = 0; k < count; ++k)
+					{
+						dst[k * 2] += src[k] * left_gain;
+						dst[k * 2 + 1] += src[k] * right_gain;
+					}
+				}
+				else
+				{
+					for(u32 k = 0; k < count; ++k)
+					{
+						dst[k * 2] += src[k * channels] * left_gain;
+						dst[k * 2 + 1] += src[k * channels + 1] * right_gain;
+					}
+				}
+
+				done += count;
+				p += count;
+				if(p == length)
+				{
+					if(!g_voice_loops[i])
+					{
+						g_voice_finished[i] = true;
+						break;
+					}
+					p = 0;
+				}
+			}
+			pos = double(p);
+		}
+		else
+		{
+			// Otherwise resample, interpolating linearly between frames.
+			for(u32 done = 0; done < frames; ++done)
+			{
+				u64 p0 = u64(pos);
+				u64 p1 = p0 + 1 < length ? p0 + 1 : (g_voice_loops[i] ? 0 : p0);
+				float t = float(pos - double(p0));
+				out[done * 2] += lerp(float(samples[p0 * channels]), float(samples[p1 * channels]), t) * left_gain;
+				out[done * 2 + 1] += lerp(float(samples[p0 * channels + right_channel]), float(samples[p1 * channels + right_channel]), t) * right_gain;
+
+				pos += step;
+				if(pos >= double(length))
+				{
+					if(!g_voice_loops[i])
+					{
+						g_voice_finished[i] = true;
+						break;
+					}
+					pos = fmod(pos, double(length));
+				}
+			}
+		}
+		g_voice_positions[i] = pos;
 	}
-
-	return idx;
 }
 
-void DestroySprite(SpriteId sprite)
+bool MixerStream::onGetData(Chunk& data)
 {
-	if(sprite < MAX_SPRITES)
 	{
-		g_sprites[sprite] = sf::Sprite();
+		std::lock_guard<std::mutex> lock(g_mixer_mutex);
+		MixVoices(&mix[0], MIXER_CHUNK_FRAMES);
 	}
+
+	for(size_t i = 0; i < mix.size(); ++i)
+		samples[i] = sf::Int16(clamp(mix[i], -1.0f, 1.0f) * 32767);
+	data.samples = &samples[0];
+	data.sampleCount = samples.size();
+	return true;
 }
 
-void DrawSprite(SpriteId sprite, int xsegments, int xsegment)
+SoundInstanceId PlaySound(SoundId sound, float volume, float pitch, bool loop)
 {
-	if(sprite < MAX_SPRITES && g_sprites[sprite].getTexture())
+	if (sound >= g_total_sounds || g_sound_pending[sound])
+		return -1;
+
+	if(g_sound_bank_files[sound] && !DecodeBankSound(sound))
+		return -1;
+
+	if(!g_voices_ready)
+		InitVoices();
+
+	std::lock_guard<std::mutex> lock(g_mixer_mutex);
+
+	// Make room by stopping another voice, if the sound is at its limit or all voices are busy.
+	bool at_limit = g_sound_voice_limits[sound] && g_sound_voice_counts[sound] >= g_sound_voice_limits[sound];
+	if(at_limit || g_voice_free_head == NO_FREE_VOICE)
 	{
-		sf::Vector2u full_size = g_sprites[sprite].getTexture()->getSize();
-		if (xsegments < 0)
-		{
-			g_sprites[sprite].setTextureRect(sf::IntRect(0, 0, full_size.x, full_size.y));
-		}
-		else
-		{
-			float s = full_size.x / (float)xsegments;
-			g_sprites[sprite].setTextureRect(sf::IntRect((int)(xsegment * s), 0, (int)s, full_size.y));
-		}
-		g_window.draw(g_sprites[sprite]);
+		u32 victim = FindVoiceToSteal(sound, at_limit);
+		if(victim == MAX_VOICES)
+			return -1;
+		StopVoice(victim);
 	}
+
+	u32 idx = g_voice_free_head;
+	g_voice_free_head = g_voice_next_free[idx];
+	g_voice_sounds[idx] = sound;
+	g_voice_buses[idx] = g_sound_buses[sound];
+	g_voice_volumes[idx] = volume;
+	g_voice_pans[idx] = 0;
+	g_voice_play_orders[idx] = g_voices_played++;
+	++g_sound_voice_counts[sound];
+
+	StartVoice(idx, pitch, loop);
+	return (SoundInstanceId(g_voice_generations[idx]) << VOICE_INDEX_BITS) | idx;
 }
 
-void DrawSprite(TextureId texture, f2 pos, f4 col)
+float GetSoundVolume(SoundInstanceId sound_instance)
 {
-	if(texture>=g_total_textures)
+	u32 idx = GetVoiceIndex(sound_instance);
+	return idx < MAX_VOICES ? g_voice_volumes[idx] : 0;
+}
+
+void SetSoundVolume(SoundInstanceId sound_instance, float volume)
+{
+	u32 idx = GetVoiceIndex(sound_instance);
+	if(idx == MAX_VOICES)
 		return;
 
-	sf::Sprite spr;
-	spr.setPosition(sf::Vector2f(pos.x, pos.y));
-	spr.setTexture(g_textures[texture]);
-	spr.setColor(Col(col));
-	g_window.draw(spr);
+	std::lock_guard<std::mutex> lock(g_mixer_mutex);
+	g_voice_volumes[idx] = volume;
+	ApplyVoiceGain(idx);
 }
 
-static sf::Sprite* GetSFMLSprite(SpriteId sprite)
+void SetSoundPan(SoundInstanceId sound_instance, float pan)
 {
-	if (sprite >= MAX_SPRITES || !g_sprites[sprite].getTexture())
-	{
-		printf("[ERR]: Invalid sprite ID!\n");
-		return nullptr;
-	}
+	u32 idx = GetVoiceIndex(sound_instance);
+	if(idx == MAX_VOICES)
+		return;
 
-	return &g_sprites[sprite];
+	std::lock_guard<std::mutex> lock(g_mixer_mutex);
+	g_voice_pans[idx] = clamp(pan, -1.0f, 1.0f);
+	ApplyVoicePan(idx);
 }
 
-f2 GetPosition(SpriteId sprite)
+void StopSound(SoundInstanceId sound)
 {
-	if (sf::Sprite* sfml_sprite = GetSFMLSprite(sprite))
-	{
-		sf::Vector2f pos = sfml_sprite->getPosition();
-		return f2(pos.x, pos.y);
-	}
-	return f2(0);
+	u32 idx = GetVoiceIndex(sound);
+	if(idx == MAX_VOICES)
+		return;
+
+	std::lock_guard<std::mutex> lock(g_mixer_mutex);
+	StopVoice(idx);
 }
 
-float GetRotation(SpriteId sprite)
+void StopAllSounds()
 {
-	if(sf::Sprite* sfml_sprite = GetSFMLSprite(sprite))
-	{
-		return (float)(sfml_sprite->getRotation() * DEG_TO_RAD);
-	}
-	return 0;
+	std::lock_guard<std::mutex> lock(g_mixer_mutex);
+	StopAllVoices();
 }
 
-f2 GetScale(SpriteId sprite)
+void SetSoundPriority(SoundId sound, u8 priority)
 {
-	if(sf::Sprite* sfml_sprite = GetSFMLSprite(sprite))
+	if(sound >= g_total_sounds)
 	{
-		sf::Vector2f scale = sfml_sprite->getScale();
-		return f2(scale.x, scale.y);
+		printf("[ERR]: Invalid sound ID.\n");
+		return;
 	}
-	return 1;
+	g_sound_priorities[sound] = priority;
 }
 
-void SetPosition(SpriteId sprite, f2 pos)
+void SetSoundVoiceLimit(SoundId sound, u32 max_voices)
 {
-	if(sf::Sprite* sfml_sprite = GetSFMLSprite(sprite))
+	if(sound >= g_total_sounds)
 	{
-		sfml_sprite->setPosition(sf::Vector2f(pos.x, pos.y));
+		printf("[ERR]: Invalid sound ID.\n");
+		return;
 	}
+	g_sound_voice_limits[sound] = u16(min(max_voices, MAX_VOICES));
 }
 
-void SetRotation(SpriteId sprite, float ang)
+void SetSoundVoiceCount(u32 count)
 {
-	if(sf::Sprite* sfml_sprite = GetSFMLSprite(sprite))
-	{
-		sfml_sprite->setRotation((float)(ang * RAD_TO_DEG));
-	}
+	ResetVoices();
+	g_voice_count = clamp(count, 1u, MAX_VOICES);
 }
 
-void SetScale(SpriteId sprite, f2 scale)
+// Applies a track's volume, scaled by how far it has faded in.
+static void UpdateMusicVolume(MusicId music)
 {
-	if(sf::Sprite* sfml_sprite = GetSFMLSprite(sprite))
-	{
-		sfml_sprite->setScale(sf::Vector2f(scale.x, scale.y));
-	}
+	float volume = g_music_volumes[music] * g_music_fades[music] * g_bus_gains[u32(SoundBus::Music)];
+	g_music[music].setVolume(volume * volume * 100.0f);
 }
 
-void SetColour(SpriteId sprite, f4 col)
+static void FadeMusic(MusicId music, float fade_seconds, bool fade_in)
 {
-	if(sf::Sprite* sfml_sprite = GetSFMLSprite(sprite))
+	float direction = fade_in ? 1.0f : -1.0f;
+	if(fade_seconds > 0)
 	{
-		sfml_sprite->setColor(Col(col));
+		g_music_fade_rates[music] = direction / fade_seconds;
+		return;
 	}
+
+	// Instant.
+	g_music_fade_rates[music] = 0;
+	g_music_fades[music] = fade_in ? 1.0f : 0.0f;
+	UpdateMusicVolume(music);
+	if(!fade_in)
+		g_music[music].stop();
 }
 
-static ShaderId LoadShaderInternal(const char* strarg, bool fromfile)
+static void UpdateMusic(float dt)
 {
-	if(!sf::Shader::isAvailable())
+	for(MusicId i = 0; i < g_total_music; ++i)
 	{
-		printf("[ERR]: Shaders not available on your platform! :(\n");
-		return -1;
+		if(g_music_fade_rates[i] == 0)
+			continue;
+
+		g_music_fades[i] = saturate(g_music_fades[i] + g_music_fade_rates[i] * dt);
+		UpdateMusicVolume(i);
+
+		// Stop tracks once they've faded out, and stop fading once they're fully in.
+		if(g_music_fades[i] == 0)
+			g_music[i].stop();
+		if(g_music_fades[i] == 0 || g_music_fades[i] == 1)
+			g_music_fade_rates[i] = 0;
 	}
+}
 
-	if(g_total_shaders < MAX_SHADERS)
+MusicId LoadMusic(const char* path)
+{
+	if(g_total_music < MAX_MUSIC)
 	{
-		bool success = fromfile ? g_shaders[g_total_shaders].loadFromFile(strarg, sf::Shader::Fragment)
-								: g_shaders[g_total_shaders].loadFromMemory(strarg, sf::Shader::Fragment);
-		if (success)
+		const u8* data;
+		u32 size;
+		if(FindPackedAsset(path, data, size) ? g_music[g_total_music].open(data, size) : g_music[g_total_music].open(path))
 		{
-			return g_total_shaders++;
+			return g_total_music++;
 		}
-	}
 
-	if(fromfile)
-		printf("[ERR]: Could not load shader from file %s\n", strarg);
-	else
-		printf("[ERR]: Could not load shader from memory!\n");
+		printf("[ERR]: Couldn't open music file %s\n", path);
+		return -1;
+	}
 
+	printf("[ERR]: No remaining music memory!\n");
 	return -1;
 }
 
-ShaderId LoadShaderFromString(const char* str)
-{
-	return LoadShaderInternal(str, false);
-}
-
-ShaderId LoadShaderFromFile(const char* path)
-{
-	return LoadShaderInternal(path, true);
-}
-
-void DrawPostEffects(ShaderId shader)
+void PlayMusic(MusicId music, float fade_seconds, float volume, bool loop)
 {
-	if (shader >= MAX_SHADERS)
+	if(music >= g_total_music)
 	{
-		printf("[ERR]: Invalid shader ID. Perhaps shaders aren't available?\n");
+		printf("[ERR]: Invalid music ID.\n");
 		return;
 	}
 
-	// Update the postprocess texture to contain the current window contents.
-	g_postprocess_texture.update(g_window);
-	g_shaders[shader].setParameter("texture", g_postprocess_texture);
+	// Fade out whatever was playing.
+	if(g_current_music != NO_MUSIC && g_current_music != music)
+		FadeMusic(g_current_music, fade_seconds, false);
+	g_current_music = music;
 
-	// Draw the postprocess texture across the whole screen, applying the given shader.
-	sf::Sprite fs_sprite;
-	fs_sprite.setTexture(g_postprocess_texture);
-	g_window.draw(fs_sprite, &g_shaders[shader]);
+	// A track that is still fading out is faded back in from where it is, rather than restarted.
+	MusicStream& stream = g_music[music];
+	g_music_volumes[music] = volume;
+	stream.looping = loop;
+	if(stream.getStatus() != sf::SoundSource::Playing)
+	{
+		stream.stop();
+		g_music_fades[music] = 0;
+		UpdateMusicVolume(music);
+		stream.play();
+	}
+	FadeMusic(music, fade_seconds, true);
 }
 
-void SetShaderParameter(ShaderId shader, const char* name, float val)
+void StopMusic(float fade_seconds)
 {
-	if(shader >= MAX_SHADERS)
-	{
-		printf("[ERR]: Invalid shader ID. Perhaps shaders aren't available?\n");
+	if(g_current_music == NO_MUSIC)
 		return;
-	}
 
-	g_shaders[shader].setParameter(name, val);
+	FadeMusic(g_current_music, fade_seconds, false);
+	g_current_music = NO_MUSIC;
 }
 
-//////////////////////////////////////////////////////////////////////////
-// Sound API
-//////////////////////////////////////////////////////////////////////////
+void SetMusicVolume(float volume)
+{
+	if(g_current_music == NO_MUSIC)
+		return;
 
-SoundId LoadSound(const char* path)
+	g_music_volumes[g_current_music] = volume;
+	UpdateMusicVolume(g_current_music);
+}
+
+// Moves fading buses towards their target volumes, and applies any change in a bus's gain to the voices playing on it.
+static void UpdateMixer(float dt)
 {
-	if(g_total_sounds < MAX_SOUNDS)
+	for(u32 i = 0; i < BUS_COUNT; ++i)
 	{
-		if(g_sound_buffers[g_total_sounds].loadFromFile(path))
+		if(g_bus_fade_rates[i] == 0)
+			continue;
+
+		float remaining = g_bus_target_volumes[i] - g_bus_volumes[i];
+		float step = g_bus_fade_rates[i] * dt;
+		if(fabs(remaining) <= step)
 		{
-			return g_total_sounds++;
+			g_bus_volumes[i] = g_bus_target_volumes[i];
+			g_bus_fade_rates[i] = 0;
+		}
+		else
+		{
+			g_bus_volumes[i] += remaining > 0 ? step : -step;
 		}
-
-		printf("[ERR]: Couldn't load sound file from %s\n", path);
-		return -1;
 	}
 
-	printf("[ERR]: No remaining sound memory!\n");
-	return -1;
-}
-
-SoundInstanceId PlaySound(SoundId sound, float volume, float pitch, bool loop)
-{
-	if (sound >= g_total_sounds)
-		return -1;
+	// Work out each bus's gain once, and only touch the voices of buses that changed.
+	bool bus_changed[BUS_COUNT];
+	bool any_changed = false;
+	float master = g_bus_volumes[u32(SoundBus::Master)];
+	for(u32 i = 0; i < BUS_COUNT; ++i)
+	{
+		float gain = i == u32(SoundBus::Master) ? master : g_bus_volumes[i] * master;
+		bus_changed[i] = gain != g_bus_gains[i];
+		any_changed |= bus_changed[i];
+		g_bus_gains[i] = gain;
+	}
+	if(!any_changed)
+		return;
 
-	for (int i = 0; i < MAX_SOUNDS; ++i)
+	if(g_voices_ready)
 	{
-		if(g_sounds[i].getStatus() == sf::SoundSource::Stopped)
+		std::lock_guard<std::mutex> lock(g_mixer_mutex);
+		for(u32 i = 0; i < g_voice_count; ++i)
 		{
-			g_sounds[i].setBuffer(g_sound_buffers[sound]);
-			g_sounds[i].setVolume(volume * volume * 100.0f);
-			g_sounds[i].setPitch(pitch);
-			g_sounds[i].setLoop(loop);
-			g_sounds[i].play();
-			return i;
+			if(g_voice_sounds[i] != NO_SOUND && bus_changed[u32(g_voice_buses[i])])
+				ApplyVoiceGain(i);
 		}
 	}
 
-	return -1;
-}
-
-float GetSoundVolume(SoundInstanceId sound_instance)
-{
-	if(sound_instance >= g_total_sounds)
+	if(bus_changed[u32(SoundBus::Music)])
 	{
-		printf("[ERR]: Invalid sound channel ID.\n");
-		return 0;
+		for(MusicId i = 0; i < g_total_music; ++i)
+			UpdateMusicVolume(i);
 	}
-
-	float vol = g_sounds[sound_instance].getVolume();
-	return sqrt(vol / 100.0f);
 }
 
-void SetSoundVolume(SoundInstanceId sound_instance, float volume)
+void SetBusVolume(SoundBus bus, float volume, float fade_seconds)
 {
-	if(sound_instance >= g_total_sounds)
+	u32 i = u32(bus);
+	if(i >= BUS_COUNT)
 	{
-		printf("[ERR]: Invalid sound channel ID.\n");
+		printf("[ERR]: Invalid sound bus.\n");
 		return;
 	}
 
-	g_sounds[sound_instance].setVolume(volume * volume * 100.0f);
+	g_bus_target_volumes[i] = volume;
+	if(fade_seconds > 0)
+	{
+		g_bus_fade_rates[i] = fabs(volume - g_bus_volumes[i]) / fade_seconds;
+	}
+	else
+	{
+		g_bus_volumes[i] = volume;
+		g_bus_fade_rates[i] = 0;
+	}
+}
+
+float GetBusVolume(SoundBus bus)
+{
+	return u32(bus) < BUS_COUNT ? g_bus_volumes[u32(bus)] : 0;
 }
 
-void StopSound(SoundInstanceId sound)
+void SetSoundBus(SoundId sound, SoundBus bus)
 {
-	if(sound >= g_total_sounds)
+	if(sound >= g_total_sounds || u32(bus) >= BUS_COUNT)
 	{
-		printf("[ERR]: Invalid sound channel ID.\n");
+		printf("[ERR]: Invalid sound ID or bus.\n");
 		return;
 	}
+	g_sound_buses[sound] = bus;
+}
 
-	if(g_sounds[sound].getStatus() != sf::SoundSource::Stopped)
-		g_sounds[sound].stop();
+void SetSoundMixer(SoundMixer mixer)
+{
+	ResetVoices();
+	g_sound_mixer = mixer;
 }
 
-void StopAllSounds()
+void MixSounds(float* stereo_samples, u32 frame_count)
 {
-	for (int i = 0; i < MAX_SOUNDS; ++i)
+	if(g_sound_mixer != SoundMixer::Offline)
 	{
-		if (g_sounds[i].getStatus() == sf::SoundSource::Playing)
-		{
-			g_sounds[i].stop();
-		}
+		printf("[ERR]: MixSounds() needs the offline mixer!\n");
+		memset(stereo_samples, 0, frame_count * 2 * sizeof(float));
+		return;
 	}
+
+	std::lock_guard<std::mutex> lock(g_mixer_mutex);
+	MixVoices(stereo_samples, frame_count);
 }
 
 //////////////////////////////////////////////////////////////////////////
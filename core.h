@@ -19,10 +19,8 @@
 	Author: Liam de Valmency (liam.devalmency@gmail.com / @Kilo_bytes)
 
 	TODO: 
-		- An internal 2D physics system would be nice.
 		- Hit pause, making sure internal timers and whatnot don't get weird
 		- Rework the sprite API to be less cumbersome.
-		- Some helper functionality for quickly creating particle systems/effects?
 		- Fix fullscreen switch requiring an alt-tab out, followed by an alt-tab back in, before the window shows its contents properly.
 		- Fix game logic continuing to run while the window is unfocused.
 		- Fix fullscreen black border + screen shake combination giving undesirable results.
@@ -35,6 +33,8 @@
 //////////////////////////////////////////////////////////////////////////
 
 #define INCLUDE_GAMEPAD_LIBRARY 0
+#define INCLUDE_PROFILER 0
+#define INCLUDE_PHYSICS 0
 
 //////////////////////////////////////////////////////////////////////////
 // Typedefs
@@ -49,11 +49,14 @@ typedef uint8_t		u8;
 typedef uint16_t	u16;
 typedef uint32_t	u32;
 typedef uint64_t	u64;
+typedef u16			EmitterId;
 typedef u16			FontId;
+typedef u16			MusicId;
 typedef u16			ShaderId;
+typedef u32			ShaderUniformId;	// Shader in the high 16 bits, uniform slot in the low 16 bits.
 typedef u16			SoundId;
-typedef u16			SoundInstanceId;
-typedef u16			SpriteId;
+typedef u32			SoundInstanceId;	// Voice index in the low 16 bits, voice generation in the high 16 bits.
+typedef u32			SpriteId;		// Slot index in the low 16 bits, slot generation in the high 16 bits.
 typedef u16			TextureId;
 typedef u16			BodyId;
 
@@ -61,6 +64,45 @@ enum class SpriteOrigin { TopLeft, Centre };
 enum class QuadAlign	{ TopLeft, Centre };
 enum class TextAlign	{ Left, Centre };
 enum class TitlebarStyle{ None, Minimal, Full };
+enum class SoundBus		{ SFX, UI, Music, Master, COUNT };
+enum class SoundMixer	{ OpenAL, Software, Offline };
+
+struct RenderStats
+{
+	u32 draw_calls;
+	u32 vertices;
+	u32 texture_binds;
+	u32 shader_binds;
+	u32 post_effect_copies;	// Full-screen copies made by DrawPostEffects().
+	u32 text_layouts;		// Strings laid out (i.e. not found in the text cache).
+	u32 draw_calls_saved;	// Draw calls avoided by batching.
+};
+
+typedef float (*EaseFunction)(float t, EaseType easing);
+
+// How a particle emitter's particles are spawned, and change over their lives.
+struct ParticleSettings
+{
+	TextureId		texture = TextureId(-1);	// Particles are untextured squares unless set.
+	u32				max_particles = 1000;
+	float			rate = 0;					// Particles emitted per second, on top of any EmitParticles() bursts.
+	float			life_min = 1;				// Seconds.
+	float			life_max = 1;
+	float			speed_min = 50;
+	float			speed_max = 100;
+	float			direction = 0;				// Radians.
+	float			spread = float(2 * PI);		// Radians either side of the direction, in total.
+	f2				gravity = f2(0);
+	float			drag = 0;					// Fraction of velocity lost per second.
+	f4				start_colour = f4(1);
+	f4				end_colour = f4(1, 1, 1, 0);
+	float			start_size = 8;
+	float			end_size = 8;
+	EaseFunction	colour_ease = EaseIn;		// Curves from start to end values over each particle's life.
+	EaseType		colour_easing = EaseType::Linear;
+	EaseFunction	size_ease = EaseIn;
+	EaseType		size_easing = EaseType::Linear;
+};
 
 //////////////////////////////////////////////////////////////////////////
 // Game API
@@ -82,6 +124,7 @@ void SetWindowIcon(const char* icon_filepath);
 void SetWindowFullscreen(bool b);
 void SetWindowTitlebarStyle(TitlebarStyle style);
 void SetWindowAntialiased(bool b);
+void SetWindowHeadless(bool b); // Renders offscreen instead of opening a window (e.g. for benchmarking on a build machine).
 
 // Window sizing / clipping / coordinates.
 void SetWindowSize(int x, int y);
@@ -93,6 +136,9 @@ void ResetWindowWorldRegion();
 // Screen shake!
 void ScreenShake(float amount);
 
+// Saves the contents of the given frame (see GetFrameNumber()) to an image file, once it has been drawn.
+void SaveFrameToFile(u64 frame, const char* path);
+
 //////////////////////////////////////////////////////////////////////////
 // Input API
 //////////////////////////////////////////////////////////////////////////
@@ -136,6 +182,11 @@ void	DrawText(const char* text, f2 pos, TextAlign align = TextAlign::Centre); //
 // Immediate font API.
 void	DrawText(const char* text, FontId font, f2 pos, u32 size_px, f4 col, TextAlign align = TextAlign::Centre, float scale = 1);
 
+// Text layout cache. Laid out strings are reused across frames, least recently used first out when over budget.
+void	SetTextCacheBudget(u32 bytes);
+u32		GetTextCacheHits();
+u32		GetTextCacheMisses();
+
 //////////////////////////////////////////////////////////////////////////
 // Graphics API
 //////////////////////////////////////////////////////////////////////////
@@ -144,9 +195,24 @@ void	DrawText(const char* text, FontId font, f2 pos, u32 size_px, f4 col, TextAl
 void		DrawQuad(f2 pos, f2 size, f4 col, QuadAlign align = QuadAlign::TopLeft);
 void		DrawQuad(f2 startpos, f2 endpos, float width, f4 col);
 void		DrawCircle(f2 pos, float radius, f4 col);
+void		SetCircleTolerance(float pixels);	// Circles get more segments as they grow on screen, keeping their edge within this many pixels of a true circle (default 0.5).
+
+// Batching (on by default). Batched geometry is flushed on state changes, so draw order is preserved.
+void		SetBatchingEnabled(bool b);
+u32			GetDrawCallsSaved(); // Draw calls saved by batching during the previous frame.
+
+// Render statistics, for the previous frame, or the min/average/max of each stat over the last 60 frames.
+RenderStats	GetRenderStats();
+RenderStats	GetRenderStatsMin();
+RenderStats	GetRenderStatsAvg();
+RenderStats	GetRenderStatsMax();
 
 // Sprite library.
 TextureId	LoadTexture(const char* path);
+TextureId	LoadTextureAsync(const char* path);	// Returns immediately, drawing a placeholder until the texture has loaded.
+void		SetTextureAtlasing(bool b);		// When enabled, small textures loaded afterwards are packed into shared atlas pages.
+u32			GetTextureAtlasPageCount();
+float		GetTextureAtlasEfficiency();	// Fraction of the atlas pages' area covered by textures.
 SpriteId	CreateSprite(TextureId texture, SpriteOrigin origin = SpriteOrigin::TopLeft);
 void		DestroySprite(SpriteId sprite);
 void		DrawSprite(SpriteId sprite, int xsegments = -1, int xsegment = 0);
@@ -158,25 +224,105 @@ void		SetRotation(SpriteId sprite, float ang);
 void		SetScale(SpriteId sprite, f2 scale);
 void		SetColour(SpriteId sprite, f4 col);
 
+// Bulk sprite API, for updating/drawing many sprites in one call.
+void		DrawSprites(const SpriteId* sprites, u32 count);
+void		SetPositions(const SpriteId* sprites, const f2* positions, u32 count);
+void		SetRotations(const SpriteId* sprites, const float* angs, u32 count);
+void		SetScales(const SpriteId* sprites, const f2* scales, u32 count);
+void		SetColours(const SpriteId* sprites, const f4* cols, u32 count);
+
 void		DrawSprite(TextureId texture, f2 pos, f4 col);
 
+// Sprites drawn between these calls are sorted by texture to minimise draw calls, so only use them when ordering within the layer doesn't matter.
+void		BeginSpriteLayer();
+void		EndSpriteLayer();
+
+// Particle library. Emitters spawn and update their particles at the start of each frame, and draw them all in one draw call.
+EmitterId	CreateEmitter(const ParticleSettings& settings);
+void		DestroyEmitter(EmitterId emitter);
+void		SetEmitterSettings(EmitterId emitter, const ParticleSettings& settings);
+void		SetEmitterPosition(EmitterId emitter, f2 pos);
+void		EmitParticles(EmitterId emitter, u32 count);
+void		DrawEmitter(EmitterId emitter);
+u32			GetParticleCount(EmitterId emitter);
+
 // Shader library.
 ShaderId	LoadShaderFromFile(const char* path);
 ShaderId	LoadShaderFromString(const char* str);
 void		DrawPostEffects(ShaderId shader);
+void		SetPostEffectChain(const ShaderId* shaders, u32 count); // Shaders applied in order to the whole frame, just before it is displayed.
 void		SetShaderParameter(ShaderId shader, const char* name, float val);
+void		SetShaderHotReload(bool b);	// Watches shaders loaded from files, and swaps in edited versions at the start of the next frame.
+
+// Shader uniforms. Look up a handle once, then set it every frame; values are uploaded when the shader is next used, and only if changed.
+ShaderUniformId	GetShaderUniform(ShaderId shader, const char* name);
+void		SetShaderUniform(ShaderUniformId uniform, float val);
+void		SetShaderUniform(ShaderUniformId uniform, f2 val);
+void		SetShaderUniform(ShaderUniformId uniform, f3 val);
+void		SetShaderUniform(ShaderUniformId uniform, f4 val);
+void		SetShaderUniformMatrix(ShaderUniformId uniform, const float* mat);	// 3x3, row major.
+void		SetShaderUniformTexture(ShaderUniformId uniform, TextureId texture);	// Atlased textures bind their whole atlas page, so disable atlasing for textures sampled by shaders.
+
+// Post effect options (ignored for antialiased windows, which don't draw offscreen).
+void		SetShaderResolutionScale(ShaderId shader, float scale);					// Runs the effect at reduced resolution, rounded to 1/2, 1/4 etc.
+void		SetShaderBlurInput(ShaderId shader, const char* name, u32 levels);		// Binds a Gaussian-blurred copy of the frame, downsampled 'levels' times, to the named texture uniform.
 
 //////////////////////////////////////////////////////////////////////////
 // Sound API
 //////////////////////////////////////////////////////////////////////////
 
 SoundId			LoadSound(const char* path);
+SoundId			LoadSoundAsync(const char* path);	// Returns immediately, the sound won't play until it has loaded.
+SoundId			LoadSoundBank(const char* path);	// Registers every sound in a bank, returning the first sound's ID, with the rest following in order.
+bool			BuildSoundBank(const char* bank_path, const char* const* sound_paths, u32 count);	// Packs sound files into a bank, in order.
+void			SetSoundBankBudget(u32 bytes);		// Bank sounds are decoded when first played, and the least recently played are freed to stay under this (16MB by default).
 SoundInstanceId	PlaySound(SoundId sound, float volume = 1, float pitch = 1, bool loop = false);
 float			GetSoundVolume(SoundInstanceId sound_instance);
 void			StopSound(SoundInstanceId sound);
 void			SetSoundVolume(SoundInstanceId sound_instance, float volume);
 void			StopAllSounds();
 
+// Sounds play on a fixed pool of voices. When they're all busy, a new sound replaces the oldest sound of the lowest
+// priority, provided that's no higher than its own, and otherwise doesn't play.
+void			SetSoundPriority(SoundId sound, u8 priority);		// Defaults to 0.
+void			SetSoundVoiceLimit(SoundId sound, u32 max_voices);	// Playing a sound more times than this replaces its oldest instance. 0 (the default) for no limit.
+void			SetSoundVoiceCount(u32 count);						// Defaults to 32, up to 256. Stops all sounds.
+
+// Mixer buses. Sounds play on the SFX bus unless set otherwise, music plays on the music bus, and every bus feeds the
+// master bus. Volume changes are applied at the start of the next frame; fade them in and out for ducking.
+void			SetBusVolume(SoundBus bus, float volume, float fade_seconds = 0);
+float			GetBusVolume(SoundBus bus);
+void			SetSoundBus(SoundId sound, SoundBus bus);
+void			SetSoundPan(SoundInstanceId sound_instance, float pan);	// From -1 (left) to 1 (right). The OpenAL mixer can only pan mono sounds.
+
+// By default each voice is an OpenAL source. The software mixer mixes every voice into a single stream instead, and
+// the offline mixer only mixes when MixSounds() is called, so works without an audio device (e.g. for testing).
+void			SetSoundMixer(SoundMixer mixer);	// Stops all sounds.
+void			MixSounds(float* stereo_samples, u32 frame_count);	// Offline mixer only. Mixes the next frame_count frames, as interleaved 44.1kHz stereo.
+
+// Music is streamed from disk while it plays, rather than loaded up front. One track plays at a time, with
+// PlayMusic() crossfading from the previous one.
+MusicId			LoadMusic(const char* path);
+void			PlayMusic(MusicId music, float fade_seconds = 0, float volume = 1, bool loop = true);
+void			StopMusic(float fade_seconds = 0);
+void			SetMusicVolume(float volume);
+
+//////////////////////////////////////////////////////////////////////////
+// Asset pack API
+//////////////////////////////////////////////////////////////////////////
+
+// Mounted packs are memory mapped, and every loader looks for its path in them before reading from disk.
+bool			MountAssetPack(const char* path);	// Packs mounted later take precedence.
+bool			BuildAssetPack(const char* pack_path, const char* const* asset_paths, u32 count);	// Packs asset files under their paths.
+
+//////////////////////////////////////////////////////////////////////////
+// Async loading API
+//////////////////////////////////////////////////////////////////////////
+
+// Async loads are decoded on background threads, then uploaded at the start of each frame.
+u32				GetPendingLoadCount();
+void			SetAsyncUploadBudget(float seconds); // Maximum time per frame spent uploading finished loads.
+
 //////////////////////////////////////////////////////////////////////////
 // Random API
 //////////////////////////////////////////////////////////////////////////
@@ -200,6 +346,13 @@ f4		RandPastelCol();
 #define ASSERT(check,msg) do {} while(0)
 #endif
 
+// Profiler zones (only active if INCLUDE_PROFILER is set, see profiler.h).
+#if INCLUDE_PROFILER
+#include "profiler.h"
+#else
+#define PROFILE_SCOPE(name) do {} while(0)
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 // INTERNAL API, PLEASE IGNORE
 //////////////////////////////////////////////////////////////////////////
@@ -139,9 +139,9 @@ static void ApplyDeadzone(int idx)
 	for(int i = 0; i < 2; ++i)
 	{
 		// Sanity check, clamp the thumbstick input to [-1,1].
-		if(abs(g_thumb[idx][i].x) > 1)
+		if(fabs(g_thumb[idx][i].x) > 1)
 			g_thumb[idx][i].x = (float)sign(g_thumb[idx][i].x);
-		if(abs(g_thumb[idx][i].y) > 1)
+		if(fabs(g_thumb[idx][i].y) > 1)
 			g_thumb[idx][i].y = (float)sign(g_thumb[idx][i].y);
 
 		float len = length(g_thumb[idx][i]);
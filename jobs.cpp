@@ -0,0 +1,189 @@
+#include "core.h"
+#include "jobs.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+// Internal types
+//////////////////////////////////////////////////////////////////////////
+
+struct JobRange
+{
+	u32 begin;
+	u32 end;
+};
+
+// A thread's queue of chunks. The owner takes from the back, and thieves take from the front.
+struct JobQueue
+{
+	std::mutex				mutex;
+	std::deque<JobRange>	ranges;
+};
+
+static const u32 MAX_JOB_THREADS = 16;
+
+// Worker threads, and the batch of jobs they're working on. Owns its threads, so they are joined on shutdown.
+struct JobSystem
+{
+	std::vector<std::thread>	workers;
+	JobQueue					queues[MAX_JOB_THREADS];	// Queue 0 belongs to the thread calling RunJobs().
+	std::mutex					mutex;
+	std::condition_variable		wake;
+	u64							batch = 0;					// Bumped for every RunJobs() call, to wake the workers.
+	bool						quitting = false;
+	JobFunction					func = nullptr;
+	void*						data = nullptr;
+	std::atomic<u32>			remaining;
+
+	~JobSystem()
+	{
+		StopWorkers();
+	}
+
+	void StopWorkers()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quitting = true;
+		}
+		wake.notify_all();
+		for(std::thread& worker : workers)
+			worker.join();
+		workers.clear();
+		quitting = false;
+	}
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Internal state
+//////////////////////////////////////////////////////////////////////////
+
+static JobSystem	g_jobs;
+static u32			g_job_thread_count = 0;	// Zero until the workers are first started.
+
+//////////////////////////////////////////////////////////////////////////
+// Internal job helpers
+//////////////////////////////////////////////////////////////////////////
+
+// Takes a chunk from the thread's own queue, or failing that, steals one from another thread's queue.
+static bool TakeJobRange(u32 thread, JobRange& range)
+{
+	{
+		JobQueue& queue = g_jobs.queues[thread];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if(!queue.ranges.empty())
+		{
+			range = queue.ranges.back();
+			queue.ranges.pop_back();
+			return true;
+		}
+	}
+
+	for(u32 i = 1; i < g_job_thread_count; ++i)
+	{
+		JobQueue& victim = g_jobs.queues[(thread + i) % g_job_thread_count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if(!victim.ranges.empty())
+		{
+			range = victim.ranges.front();
+			victim.ranges.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+// Runs chunks until there are none left to take.
+static void RunJobRanges(u32 thread)
+{
+	JobRange range;
+	while(TakeJobRange(thread, range))
+	{
+		for(u32 i = range.begin; i < range.end; ++i)
+			g_jobs.func(g_jobs.data, i);
+		g_jobs.remaining -= range.end - range.begin;
+	}
+}
+
+static void JobWorker(u32 thread)
+{
+	u64 batch = 0;
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(g_jobs.mutex);
+			g_jobs.wake.wait(lock, [&] { return g_jobs.quitting || g_jobs.batch != batch; });
+			if(g_jobs.quitting)
+				return;
+			batch = g_jobs.batch;
+		}
+		RunJobRanges(thread);
+	}
+}
+
+static void StartJobThreads(u32 count)
+{
+	g_jobs.StopWorkers();
+	g_job_thread_count = clamp(count, 1u, MAX_JOB_THREADS);
+	for(u32 i = 1; i < g_job_thread_count; ++i)
+		g_jobs.workers.push_back(std::thread(JobWorker, i));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public job API
+//////////////////////////////////////////////////////////////////////////
+
+void RunJobs(JobFunction func, void* data, u32 count)
+{
+	if(g_job_thread_count == 0)
+		StartJobThreads(std::thread::hardware_concurrency());
+
+	// Not worth waking the workers for.
+	if(g_job_thread_count == 1 || count <= 1)
+	{
+		for(u32 i = 0; i < count; ++i)
+			func(data, i);
+		return;
+	}
+
+	// A few chunks per thread, so there is something left to steal when the work is uneven.
+	u32 chunk_size = max(count / (g_job_thread_count * 4), 1u);
+	g_jobs.func = func;
+	g_jobs.data = data;
+	g_jobs.remaining = count;
+	u32 queue = 0;
+	for(u32 begin = 0; begin < count; begin += chunk_size)
+	{
+		JobRange range = { begin, min(begin + chunk_size, count) };
+		std::lock_guard<std::mutex> lock(g_jobs.queues[queue].mutex);
+		g_jobs.queues[queue].ranges.push_back(range);
+		queue = (queue + 1) % g_job_thread_count;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(g_jobs.mutex);
+		++g_jobs.batch;
+	}
+	g_jobs.wake.notify_all();
+
+	// Help out, then wait for any chunks still running on other threads.
+	RunJobRanges(0);
+	while(g_jobs.remaining > 0)
+		std::this_thread::yield();
+}
+
+void SetJobThreadCount(u32 count)
+{
+	StartJobThreads(count);
+}
+
+u32 GetJobThreadCount()
+{
+	if(g_job_thread_count == 0)
+		return clamp(std::thread::hardware_concurrency(), 1u, MAX_JOB_THREADS);
+	return g_job_thread_count;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Overview
+//////////////////////////////////////////////////////////////////////////
+/*
+	A small work-stealing job system, for spreading loops over all cores.
+
+	RunJobs() splits a range of indices into chunks, and deals them out to
+	per-thread queues. Each thread works through its own queue, and steals
+	from the others once it runs dry. The calling thread joins in, and
+	RunJobs() returns once every index has been processed.
+
+	Jobs must not call RunJobs() themselves. Which thread runs an index
+	varies from run to run, so jobs should only write to data owned by
+	their own index if results need to be repeatable.
+*/
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+//////////////////////////////////////////////////////////////////////////
+
+typedef void (*JobFunction)(void* data, u32 index);
+
+//////////////////////////////////////////////////////////////////////////
+// Public job API
+//////////////////////////////////////////////////////////////////////////
+
+void	RunJobs(JobFunction func, void* data, u32 count);	// Calls func(data, i) for every i below count, across all job threads.
+void	SetJobThreadCount(u32 count);	// Including the calling thread, so 1 runs everything serially. Defaults to the core count.
+u32		GetJobThreadCount();
@@ -7,7 +7,7 @@
 bool CircleCircleIntersect(f2 circle1_pos, float circle1_radius, f2 circle2_pos, float circle2_radius)
 {
 	f2 dist = circle2_pos - circle1_pos;
-	return dot(dist, dist) <= pow(circle1_radius + circle1_radius, 2);
+	return dot(dist, dist) <= pow(circle1_radius + circle2_radius, 2);
 }
 
 bool SquareCircleIntersect(f2 square_pos, f2 square_size, f2 circle_pos, float circle_radius)
@@ -27,8 +27,8 @@ bool SquareCircleIntersect(f2 square_pos, f2 square_size, f2 circle_pos, float c
 
 bool SquareSquareIntersect(f2 square1_pos, f2 square1_size, f2 square2_pos, f2 square2_size)
 {
-	bool xintersect = abs(square1_pos.x - square2_pos.x) * 2 < abs(square1_size.x + square2_size.y);
-	bool yintersect = abs(square1_pos.y - square2_pos.y) * 2 < abs(square1_size.x + square2_size.y);
+	bool xintersect = fabs(square1_pos.x - square2_pos.x) * 2 < fabs(square1_size.x + square2_size.x);
+	bool yintersect = fabs(square1_pos.y - square2_pos.y) * 2 < fabs(square1_size.y + square2_size.y);
 	return xintersect && yintersect;
 }
 
@@ -46,6 +46,46 @@ bool OBBCircleIntersect(f2 bbstart, f2 bbend, float bbwidth, f2 circle_pos, floa
 	return SquareCircleIntersect(0, f2(bbwidth, length(bbend-bbstart)), localcirc, circle_radius);
 }
 
+void GetOBBCorners(f2 bbstart, f2 bbend, float bbwidth, f2* corners, f2* axes)
+{
+	float len = length(bbend-bbstart);
+	f2 dir = len > 0 ? (bbend-bbstart) / len : f2(0, 1);
+	if (axes)
+	{
+		axes[0] = dir;
+		axes[1] = perp(dir);
+	}
+	f2 side = perp(dir)*bbwidth*0.5f;
+	corners[0] = bbstart-side;
+	corners[1] = bbstart+side;
+	corners[2] = bbend+side;
+	corners[3] = bbend-side;
+}
+
+bool OBBOBBIntersect(f2 bb1start, f2 bb1end, float bb1width, f2 bb2start, f2 bb2end, float bb2width)
+{
+	// Separating axis test, using the edge normals of both boxes.
+	f2 corners1[4], corners2[4], axes[4];
+	GetOBBCorners(bb1start, bb1end, bb1width, corners1, axes);
+	GetOBBCorners(bb2start, bb2end, bb2width, corners2, axes+2);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		float min1 = dot(corners1[0], axes[i]), max1 = min1;
+		float min2 = dot(corners2[0], axes[i]), max2 = min2;
+		for (int j = 1; j < 4; ++j)
+		{
+			float p1 = dot(corners1[j], axes[i]);
+			float p2 = dot(corners2[j], axes[i]);
+			min1 = min(min1, p1); max1 = max(max1, p1);
+			min2 = min(min2, p2); max2 = max(max2, p2);
+		}
+		if (max1 < min2 || max2 < min1)
+			return false;
+	}
+	return true;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Spline functionality.
 //////////////////////////////////////////////////////////////////////////
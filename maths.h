@@ -123,7 +123,7 @@ inline float	cross(f2 a, f2 b)	{ return a.x*b.y - a.y*b.x; }
 inline float	length(f2 v)		{ return sqrt(squared_len(v)); }
 inline f2		normalize(f2 v)		{ return v / length(v); }
 inline f2		sign(f2 v)			{ return f2(v.x < 0 ? -1.0f : 1.0f, v.y < 0 ? -1.0f : 1.0f); }
-inline f2		abs(f2 v)			{ return f2(abs(v.x), abs(v.y)); }
+inline f2		abs(f2 v)			{ return f2(fabs(v.x), fabs(v.y)); }
 inline f2		rotate(f2 v,float a){ float sa=sin(a); float ca=cos(a); return f2(v.x*ca-v.y*sa,v.x*sa+v.y*ca); }
 inline f2		perp(f2 v)			{ return f2(v.y, -v.x); }
 inline f2		scaledperp(f2 v, float s) { return perp(v)*s; }
@@ -143,7 +143,7 @@ inline f3		cross(f3 a, f3 b)	{ return f3(a.y*b.z-a.z*b.y, a.z*b.x-a.x*b.z, a.x*b
 inline float	length(f3 v)		{ return sqrt(dot(v, v)); }
 inline f3		normalize(f3 v)		{ return v / length(v); }
 inline f3		sign(f3 v)			{ return f3(v.x < 0 ? -1.0f : 1.0f, v.y < 0 ? -1.0f : 1.0f, v.z < 0 ? -1.0f : 1.0f); }
-inline f3		abs(f3 v)			{ return f3(abs(v.x), abs(v.y), abs(v.z)); }
+inline f3		abs(f3 v)			{ return f3(fabs(v.x), fabs(v.y), fabs(v.z)); }
 inline f3		min(f3 a, f3 b)		{ return f3(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z)); }
 inline f3		max(f3 a, f3 b)		{ return f3(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z)); }
 inline float	min3(f3 v)			{ return min(v.x,min(v.y,v.z)); }
@@ -159,7 +159,7 @@ inline float	squared_len(f4 v)	{ return dot(v, v); }
 inline float	length(f4 v)		{ return sqrt(squared_len(v)); }
 inline f4		normalize(f4 v)		{ return v / length(v); }
 inline f4		sign(f4 v)			{ return f4(v.x < 0 ? -1.0f : 1.0f, v.y < 0 ? -1.0f : 1.0f, v.z < 0 ? -1.0f : 1.0f, v.w < 0 ? -1.0f : 1.0f); }
-inline f4		abs(f4 v)			{ return f4(abs(v.x), abs(v.y), abs(v.z), abs(v.w)); }
+inline f4		abs(f4 v)			{ return f4(fabs(v.x), fabs(v.y), fabs(v.z), fabs(v.w)); }
 inline f4		min(f4 a, f4 b)		{ return f4(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z), min(a.w, b.w)); }
 inline f4		max(f4 a, f4 b)		{ return f4(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z), max(a.w, b.w)); }
 inline float	min4(f4 v)			{ return min(v.x,min(v.y,min(v.z,v.w))); }
@@ -174,6 +174,8 @@ bool CircleCircleIntersect(f2 circle1_pos, float circle1_radius, f2 circle2_pos,
 bool SquareCircleIntersect(f2 square_pos, f2 square_size, f2 circle_pos, float circle_radius);
 bool SquareSquareIntersect(f2 square1_pos, f2 square1_size, f2 square2_pos, f2 square2_size);
 bool OBBCircleIntersect(f2 bbstart, f2 bbend, float bbwidth, f2 circle_pos, float circle_radius);
+bool OBBOBBIntersect(f2 bb1start, f2 bb1end, float bb1width, f2 bb2start, f2 bb2end, float bb2width);
+void GetOBBCorners(f2 bbstart, f2 bbend, float bbwidth, f2* corners, f2* axes = nullptr);	// Fills in the OBB's 4 corners, and its 2 axes if given.
 
 //////////////////////////////////////////////////////////////////////////
 // Spline functionality.
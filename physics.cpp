@@ -0,0 +1,965 @@
+#include "core.h"
+#include "collision.h"
+#include "jobs.h"
+#include "physics.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+#if INCLUDE_PHYSICS
+
+//////////////////////////////////////////////////////////////////////////
+// Internal types
+//////////////////////////////////////////////////////////////////////////
+
+enum class BodyShape : u8 { None, Circle, Box };
+
+struct Contact
+{
+	f2 pos;
+	f2 ra;				// Offsets from each body's centre.
+	f2 rb;
+	float separation;	// Negative when penetrating.
+	float normal_impulse;
+	float tangent_impulse;
+	float normal_mass;
+	float tangent_mass;
+	float bias;
+};
+
+// Contacts between two bodies, with the normal pointing from a to b.
+struct Manifold
+{
+	u16 a;
+	u16 b;
+	f2 normal;
+	float friction;
+	float restitution;
+	u32 contact_count;
+	Contact contacts[2];
+	float k11, k12, k22;	// Effective mass matrix of a two point manifold, for solving both points together.
+	bool block_solve;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Internal state
+//////////////////////////////////////////////////////////////////////////
+
+static const u16		MAX_BODIES = 8192;
+static const u16		NO_BODY = 0xFFFF;
+static const u32		MAX_STEPS_PER_FRAME = 4;		// Stops a slow frame from snowballing into slower frames.
+static const float		BAUMGARTE = 0.2f;				// Fraction of penetration corrected per step.
+static const float		PENETRATION_SLOP = 0.5f;		// Penetration allowed without correction, to keep contacts stable.
+static const float		RESTITUTION_THRESHOLD = 60;		// Closing speed below which contacts don't bounce.
+static const float		WARM_START_DISTANCE = 2;		// Contacts this close to one from the last step reuse its impulses.
+static const float		SLEEP_LINEAR_SPEED = 8;
+static const float		SLEEP_ANGULAR_SPEED = 0.05f;
+static const float		SLEEP_TIME = 0.5f;				// Time an island must stay still before it sleeps.
+
+// Bodies
+static BodyShape		g_body_shapes[MAX_BODIES];
+static f2				g_body_positions[MAX_BODIES];
+static float			g_body_rotations[MAX_BODIES];
+static f2				g_body_velocities[MAX_BODIES];
+static float			g_body_angular_velocities[MAX_BODIES];
+static f2				g_body_sizes[MAX_BODIES];			// Radius for circles, half extents for boxes.
+static float			g_body_inv_masses[MAX_BODIES];		// Zero for static bodies.
+static float			g_body_inv_inertias[MAX_BODIES];
+static float			g_body_restitutions[MAX_BODIES];
+static float			g_body_frictions[MAX_BODIES];
+static float			g_body_sleep_times[MAX_BODIES];
+static bool				g_body_awake[MAX_BODIES];			// Static bodies are never awake.
+static bool				g_body_moved[MAX_BODIES];			// Moved during this frame's steps, so its sprite needs updating.
+static u16				g_body_island_next[MAX_BODIES];		// Sleeping islands are linked into rings, so they can be woken together.
+static ColliderId		g_body_colliders[MAX_BODIES];
+static SpriteId			g_body_sprites[MAX_BODIES];
+static u16				g_body_next_free[MAX_BODIES];
+static u16				g_body_free_head = NO_BODY;
+static u32				g_total_bodies = 0;
+static std::vector<u16>	g_collider_bodies;					// Body owning each collider slot, if any.
+
+// World
+static f2				g_gravity = f2(0, 980);
+static float			g_timestep = 1.0f / 60.0f;
+static float			g_time_accumulator = 0;
+static u32				g_iterations = 8;
+static bool				g_physics_paused = false;
+
+// Contacts, and the previous step's contacts for warm starting.
+static std::vector<Manifold>			g_manifolds;
+static std::vector<Manifold>			g_prev_manifolds;
+static std::unordered_map<u32, u32>		g_prev_manifold_lookup;
+
+// Islands, as ranges of g_island_bodies and g_island_manifolds.
+static std::vector<u16>		g_island_parents;
+static std::vector<u16>		g_island_bodies;
+static std::vector<u32>		g_island_manifolds;
+static std::vector<u32>		g_island_body_starts;
+static std::vector<u32>		g_island_manifold_starts;
+
+//////////////////////////////////////////////////////////////////////////
+// Bodies
+//////////////////////////////////////////////////////////////////////////
+
+static u32 GetCheckedBodyIndex(BodyId body)
+{
+	if(body >= g_total_bodies || g_body_shapes[body] == BodyShape::None)
+	{
+		printf("[ERR]: Invalid body ID!\n");
+		return MAX_BODIES;
+	}
+	return body;
+}
+
+static bool IsDynamic(u32 body)
+{
+	return g_body_inv_masses[body] > 0;
+}
+
+// Moves a body's collider to match the body.
+static void UpdateBodyCollider(u32 body)
+{
+	f2 pos = g_body_positions[body];
+	f2 size = g_body_sizes[body];
+	if(g_body_shapes[body] == BodyShape::Circle)
+	{
+		SetCircleCollider(g_body_colliders[body], pos, size.x);
+	}
+	else
+	{
+		float rot = g_body_rotations[body];
+		f2 axis_y = f2(-sin(rot), cos(rot)) * size.y;
+		SetOBBCollider(g_body_colliders[body], pos - axis_y, pos + axis_y, size.x * 2);
+	}
+}
+
+static void SyncBodySprite(u32 body)
+{
+	if(g_body_sprites[body] != SpriteId(-1))
+	{
+		SetPosition(g_body_sprites[body], g_body_positions[body]);
+		SetRotation(g_body_sprites[body], g_body_rotations[body]);
+	}
+}
+
+// Wakes a body, along with the rest of the island it fell asleep in.
+static void WakeBody(u32 body)
+{
+	if(g_body_awake[body] || !IsDynamic(body))
+		return;
+
+	u32 i = body;
+	do
+	{
+		u32 next = g_body_island_next[i];
+		g_body_awake[i] = true;
+		g_body_sleep_times[i] = 0;
+		g_body_island_next[i] = u16(i);
+		i = next;
+	}
+	while(i != body);
+}
+
+// Wakes the bodies touching a body that is about to move or disappear, so they don't hang in the air.
+static void WakeBodiesNear(u32 body)
+{
+	f2 extent = f2(max2(g_body_sizes[body]) * 1.5f + PENETRATION_SLOP);
+	ColliderId colliders[64];
+	u32 count = QueryColliders(g_body_positions[body] - extent, extent * 2, colliders, 64);
+	for(u32 i = 0; i < count; ++i)
+	{
+		u32 slot = colliders[i] & 0xFFFFF;
+		if(slot < g_collider_bodies.size() && g_collider_bodies[slot] != NO_BODY)
+			WakeBody(g_collider_bodies[slot]);
+	}
+	WakeBody(body);
+}
+
+static BodyId CreateBody(BodyShape shape, f2 pos, f2 size, float mass, float inertia)
+{
+	// Reuse a destroyed slot if there is one, otherwise take a fresh one.
+	u32 idx;
+	if(g_body_free_head != NO_BODY)
+	{
+		idx = g_body_free_head;
+		g_body_free_head = g_body_next_free[idx];
+	}
+	else if(g_total_bodies < MAX_BODIES - 1)
+	{
+		idx = g_total_bodies++;
+	}
+	else
+	{
+		printf("[ERR]: Out of physics body memory!\n");
+		return -1;
+	}
+
+	g_body_shapes[idx]				= shape;
+	g_body_positions[idx]			= pos;
+	g_body_rotations[idx]			= 0;
+	g_body_velocities[idx]			= f2(0);
+	g_body_angular_velocities[idx]	= 0;
+	g_body_sizes[idx]				= size;
+	g_body_inv_masses[idx]			= mass > 0 ? 1 / mass : 0;
+	g_body_inv_inertias[idx]		= inertia > 0 ? 1 / inertia : 0;
+	g_body_restitutions[idx]		= 0;
+	g_body_frictions[idx]			= 0.5f;
+	g_body_sleep_times[idx]			= 0;
+	g_body_awake[idx]				= mass > 0;
+	g_body_island_next[idx]			= u16(idx);
+	g_body_sprites[idx]				= SpriteId(-1);
+
+	g_body_colliders[idx] = shape == BodyShape::Circle ? CreateCircleCollider(pos, size.x) : CreateOBBCollider(pos, pos, 0);
+	u32 slot = g_body_colliders[idx] & 0xFFFFF;
+	if(slot >= g_collider_bodies.size())
+		g_collider_bodies.resize(slot + 1, NO_BODY);
+	g_collider_bodies[slot] = u16(idx);
+	UpdateBodyCollider(idx);
+
+	return BodyId(idx);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Narrowphase
+//////////////////////////////////////////////////////////////////////////
+
+static void AddContact(Manifold& m, f2 pos, float separation)
+{
+	Contact& c = m.contacts[m.contact_count++];
+	c.pos = pos;
+	c.separation = separation;
+	c.normal_impulse = 0;
+	c.tangent_impulse = 0;
+}
+
+static bool CollideCircles(u32 a, u32 b, Manifold& m)
+{
+	float ra = g_body_sizes[a].x;
+	float rb = g_body_sizes[b].x;
+	f2 d = g_body_positions[b] - g_body_positions[a];
+	float dist_sq = squared_len(d);
+	if(dist_sq > (ra + rb) * (ra + rb))
+		return false;
+
+	float dist = sqrt(dist_sq);
+	m.normal = dist > 0 ? d / dist : f2(0, 1);
+	AddContact(m, g_body_positions[a] + m.normal * ra, dist - ra - rb);
+	return true;
+}
+
+// Collides a box with a circle, giving a normal pointing from the box to the circle.
+static bool CollideBoxCircle(u32 box, u32 circle, Manifold& m)
+{
+	float rot = g_body_rotations[box];
+	f2 half = g_body_sizes[box];
+	float radius = g_body_sizes[circle].x;
+	f2 local = rotate(g_body_positions[circle] - g_body_positions[box], -rot);
+	f2 closest = f2(clamp(local.x, -half.x, half.x), clamp(local.y, -half.y, half.y));
+
+	f2 local_normal;
+	float separation;
+	if(closest.x == local.x && closest.y == local.y)
+	{
+		// The circle's centre is inside the box, so push it out through the nearest face.
+		f2 depth = half - abs(local);
+		if(depth.x < depth.y)
+		{
+			local_normal = f2(local.x < 0 ? -1.0f : 1.0f, 0);
+			closest.x = local_normal.x * half.x;
+		}
+		else
+		{
+			local_normal = f2(0, local.y < 0 ? -1.0f : 1.0f);
+			closest.y = local_normal.y * half.y;
+		}
+		separation = -min(depth.x, depth.y) - radius;
+	}
+	else
+	{
+		f2 d = local - closest;
+		float dist = length(d);
+		if(dist > radius)
+			return false;
+		local_normal = d / dist;
+		separation = dist - radius;
+	}
+
+	m.normal = rotate(local_normal, rot);
+	AddContact(m, g_body_positions[box] + rotate(closest, rot), separation);
+	return true;
+}
+
+// Keeps the part of a segment on the negative side of a plane, returning the number of points left.
+static u32 ClipSegment(f2* points, f2 normal, float offset)
+{
+	float d0 = dot(normal, points[0]) - offset;
+	float d1 = dot(normal, points[1]) - offset;
+	if(d0 > 0 && d1 > 0)
+		return 0;
+
+	if(d0 > 0)
+		points[0] = points[0] + (points[1] - points[0]) * (d0 / (d0 - d1));
+	else if(d1 > 0)
+		points[1] = points[1] + (points[0] - points[1]) * (d1 / (d1 - d0));
+	return 2;
+}
+
+// Collides two boxes, clipping the incident box's closest face against the reference face.
+static bool CollideBoxes(u32 a, u32 b, Manifold& m)
+{
+	u32 boxes[2] = { a, b };
+	f2 axes[2][2];
+	f2 halves[2] = { g_body_sizes[a], g_body_sizes[b] };
+	for(u32 i = 0; i < 2; ++i)
+	{
+		float rot = g_body_rotations[boxes[i]];
+		axes[i][0] = f2(cos(rot), sin(rot));
+		axes[i][1] = f2(-sin(rot), cos(rot));
+	}
+	f2 d = g_body_positions[b] - g_body_positions[a];
+
+	// Find the face axis with the least penetration, preferring box a's faces to keep the choice stable.
+	u32 ref = 0, ref_axis = 0;
+	float best_separation = -1e30f;
+	for(u32 i = 0; i < 2; ++i)
+	{
+		u32 other = 1 - i;
+		for(u32 j = 0; j < 2; ++j)
+		{
+			f2 axis = axes[i][j];
+			float projected = halves[other].x * fabs(dot(axis, axes[other][0])) + halves[other].y * fabs(dot(axis, axes[other][1]));
+			float separation = fabs(dot(d, axis)) - (j == 0 ? halves[i].x : halves[i].y) - projected;
+			if(separation > 0)
+				return false;
+			if(separation > best_separation * 0.95f + 0.01f)
+			{
+				best_separation = separation;
+				ref = i;
+				ref_axis = j;
+			}
+		}
+	}
+
+	u32 inc = 1 - ref;
+	f2 ref_pos = g_body_positions[boxes[ref]];
+	f2 inc_pos = g_body_positions[boxes[inc]];
+	f2 normal = axes[ref][ref_axis];
+	if(dot(inc_pos - ref_pos, normal) < 0)
+		normal = -normal;
+	float ref_half = ref_axis == 0 ? halves[ref].x : halves[ref].y;
+	float ref_side_half = ref_axis == 0 ? halves[ref].y : halves[ref].x;
+	f2 tangent = perp(normal);
+
+	// The incident face is the one facing most directly against the normal.
+	u32 inc_axis = fabs(dot(normal, axes[inc][0])) > fabs(dot(normal, axes[inc][1])) ? 0 : 1;
+	f2 inc_normal = axes[inc][inc_axis] * (dot(normal, axes[inc][inc_axis]) > 0 ? -1.0f : 1.0f);
+	f2 inc_side = axes[inc][1 - inc_axis] * (inc_axis == 0 ? halves[inc].y : halves[inc].x);
+	f2 inc_face = inc_pos + inc_normal * (inc_axis == 0 ? halves[inc].x : halves[inc].y);
+	f2 points[2] = { inc_face - inc_side, inc_face + inc_side };
+
+	// Clip the incident face to the sides of the reference face.
+	float side = dot(tangent, ref_pos);
+	if(ClipSegment(points, tangent, side + ref_side_half) < 2 || ClipSegment(points, -tangent, -side + ref_side_half) < 2)
+		return false;
+
+	m.normal = ref == 0 ? normal : -normal;
+	float front = dot(normal, ref_pos) + ref_half;
+	for(u32 i = 0; i < 2; ++i)
+	{
+		float separation = dot(normal, points[i]) - front;
+		if(separation <= 0)
+			AddContact(m, points[i], separation);
+	}
+	return m.contact_count > 0;
+}
+
+static bool CollideBodies(u32 a, u32 b, Manifold& m)
+{
+	m.a = u16(a);
+	m.b = u16(b);
+	m.contact_count = 0;
+	m.friction = sqrt(g_body_frictions[a] * g_body_frictions[b]);
+	m.restitution = max(g_body_restitutions[a], g_body_restitutions[b]);
+
+	BodyShape shape_a = g_body_shapes[a];
+	BodyShape shape_b = g_body_shapes[b];
+	if(shape_a == BodyShape::Circle && shape_b == BodyShape::Circle)
+		return CollideCircles(a, b, m);
+	if(shape_a == BodyShape::Box && shape_b == BodyShape::Box)
+		return CollideBoxes(a, b, m);
+	if(shape_a == BodyShape::Box)
+		return CollideBoxCircle(a, b, m);
+
+	if(!CollideBoxCircle(b, a, m))
+		return false;
+	m.normal = -m.normal;
+	return true;
+}
+
+// Finds the bodies of a candidate pair, ordered by index. Returns false if either collider isn't a body's.
+static bool GetPairBodies(const ColliderPair& pair, u32& a, u32& b)
+{
+	u32 slot_a = pair.a & 0xFFFFF;
+	u32 slot_b = pair.b & 0xFFFFF;
+	if(slot_a >= g_collider_bodies.size() || slot_b >= g_collider_bodies.size())
+		return false;
+	a = g_collider_bodies[slot_a];
+	b = g_collider_bodies[slot_b];
+	if(a == NO_BODY || b == NO_BODY)
+		return false;
+	if(a > b)
+		std::swap(a, b);
+	return true;
+}
+
+// Finds the contacts for this step, waking sleeping bodies that are hit by awake ones.
+static void FindContacts()
+{
+	std::swap(g_manifolds, g_prev_manifolds);
+	g_manifolds.clear();
+	g_prev_manifold_lookup.clear();
+	for(u32 i = 0; i < g_prev_manifolds.size(); ++i)
+		g_prev_manifold_lookup[(u32(g_prev_manifolds[i].a) << 16) | g_prev_manifolds[i].b] = i;
+
+	const ColliderPair* pairs;
+	u32 pair_count = FindCandidatePairs(&pairs);
+
+	// Wake everything that's touched first, until nothing else wakes. Otherwise a pair of sleeping bodies skipped
+	// before one of them was woken would lose its contacts for a step, and resting stacks would sag on waking.
+	for(bool woken = true; woken;)
+	{
+		woken = false;
+		for(u32 i = 0; i < pair_count; ++i)
+		{
+			u32 a, b;
+			if(!GetPairBodies(pairs[i], a, b) || g_body_awake[a] == g_body_awake[b] || !IsDynamic(g_body_awake[a] ? b : a))
+				continue;
+
+			Manifold m;
+			if(CollideBodies(a, b, m))
+			{
+				WakeBody(a);
+				WakeBody(b);
+				woken = true;
+			}
+		}
+	}
+
+	for(u32 i = 0; i < pair_count; ++i)
+	{
+		u32 a, b;
+		if(!GetPairBodies(pairs[i], a, b) || (!g_body_awake[a] && !g_body_awake[b]))
+			continue;
+
+		Manifold m;
+		if(!CollideBodies(a, b, m))
+			continue;
+
+		// Start from the impulses of matching contacts in the last step.
+		auto prev = g_prev_manifold_lookup.find((a << 16) | b);
+		if(prev != g_prev_manifold_lookup.end())
+		{
+			const Manifold& old = g_prev_manifolds[prev->second];
+			for(u32 j = 0; j < m.contact_count; ++j)
+			{
+				for(u32 k = 0; k < old.contact_count; ++k)
+				{
+					if(squared_len(m.contacts[j].pos - old.contacts[k].pos) < WARM_START_DISTANCE * WARM_START_DISTANCE)
+					{
+						m.contacts[j].normal_impulse = old.contacts[k].normal_impulse;
+						m.contacts[j].tangent_impulse = old.contacts[k].tangent_impulse;
+						break;
+					}
+				}
+			}
+		}
+		g_manifolds.push_back(m);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Islands
+//////////////////////////////////////////////////////////////////////////
+
+static u32 FindIslandRoot(u32 body)
+{
+	while(g_island_parents[body] != body)
+	{
+		g_island_parents[body] = g_island_parents[g_island_parents[body]];
+		body = g_island_parents[body];
+	}
+	return body;
+}
+
+// Groups the awake bodies into islands connected by contacts, along with their contacts. Static bodies don't join
+// islands together, since nothing done to one island can move them.
+static void BuildIslands()
+{
+	g_island_parents.resize(g_total_bodies);
+	for(u32 i = 0; i < g_total_bodies; ++i)
+		g_island_parents[i] = u16(i);
+	for(const Manifold& m : g_manifolds)
+	{
+		if(IsDynamic(m.a) && IsDynamic(m.b))
+		{
+			u32 root_a = FindIslandRoot(m.a);
+			u32 root_b = FindIslandRoot(m.b);
+			g_island_parents[max(root_a, root_b)] = u16(min(root_a, root_b));
+		}
+	}
+
+	// Number the islands in order of their lowest body, so they come out the same way every time.
+	std::vector<u32> island_of(g_total_bodies, u32(-1));
+	std::vector<u32> body_counts;
+	for(u32 i = 0; i < g_total_bodies; ++i)
+	{
+		if(!g_body_awake[i])
+			continue;
+		u32 root = FindIslandRoot(i);
+		if(island_of[root] == u32(-1))
+		{
+			island_of[root] = u32(body_counts.size());
+			body_counts.push_back(0);
+		}
+		island_of[i] = island_of[root];
+		++body_counts[island_of[i]];
+	}
+
+	u32 island_count = u32(body_counts.size());
+	g_island_body_starts.assign(island_count + 1, 0);
+	g_island_manifold_starts.assign(island_count + 1, 0);
+	for(u32 i = 0; i < island_count; ++i)
+		g_island_body_starts[i + 1] = g_island_body_starts[i] + body_counts[i];
+
+	// Bucket the bodies and contacts by island, keeping them in order within each island.
+	std::vector<u32> cursor(g_island_body_starts.begin(), g_island_body_starts.end() - 1);
+	g_island_bodies.resize(g_island_body_starts[island_count]);
+	for(u32 i = 0; i < g_total_bodies; ++i)
+	{
+		if(g_body_awake[i])
+			g_island_bodies[cursor[island_of[i]]++] = u16(i);
+	}
+
+	std::vector<u32> manifold_islands(g_manifolds.size());
+	for(u32 i = 0; i < g_manifolds.size(); ++i)
+	{
+		const Manifold& m = g_manifolds[i];
+		manifold_islands[i] = island_of[IsDynamic(m.a) ? m.a : m.b];
+		++g_island_manifold_starts[manifold_islands[i] + 1];
+	}
+	for(u32 i = 0; i < island_count; ++i)
+		g_island_manifold_starts[i + 1] += g_island_manifold_starts[i];
+
+	cursor.assign(g_island_manifold_starts.begin(), g_island_manifold_starts.end() - 1);
+	g_island_manifolds.resize(g_manifolds.size());
+	for(u32 i = 0; i < g_manifolds.size(); ++i)
+		g_island_manifolds[cursor[manifold_islands[i]]++] = i;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Solver
+//////////////////////////////////////////////////////////////////////////
+
+static f2 CrossScalar(float w, f2 r)
+{
+	return f2(-w * r.y, w * r.x);
+}
+
+// Static bodies are left untouched, as they can be shared by islands being solved on other threads.
+static void ApplyContactImpulse(const Manifold& m, const Contact& c, f2 impulse)
+{
+	if(g_body_inv_masses[m.a] > 0)
+	{
+		g_body_velocities[m.a] -= impulse * g_body_inv_masses[m.a];
+		g_body_angular_velocities[m.a] -= g_body_inv_inertias[m.a] * cross(c.ra, impulse);
+	}
+	if(g_body_inv_masses[m.b] > 0)
+	{
+		g_body_velocities[m.b] += impulse * g_body_inv_masses[m.b];
+		g_body_angular_velocities[m.b] += g_body_inv_inertias[m.b] * cross(c.rb, impulse);
+	}
+}
+
+static f2 GetRelativeVelocity(const Manifold& m, const Contact& c)
+{
+	return g_body_velocities[m.b] + CrossScalar(g_body_angular_velocities[m.b], c.rb)
+		 - g_body_velocities[m.a] - CrossScalar(g_body_angular_velocities[m.a], c.ra);
+}
+
+// Solves the normal impulses of a two point manifold together, as a tiny linear complementarity problem: both points
+// pushing, only one of them pushing, or neither.
+static void SolveContactBlock(Manifold& m)
+{
+	Contact& c1 = m.contacts[0];
+	Contact& c2 = m.contacts[1];
+	float a1 = c1.normal_impulse, a2 = c2.normal_impulse;
+
+	// Relative normal velocities, with the current impulses taken back out.
+	float b1 = dot(GetRelativeVelocity(m, c1), m.normal) - c1.bias - (m.k11 * a1 + m.k12 * a2);
+	float b2 = dot(GetRelativeVelocity(m, c2), m.normal) - c2.bias - (m.k12 * a1 + m.k22 * a2);
+
+	float x1, x2;
+	float det = m.k11 * m.k22 - m.k12 * m.k12;
+	x1 = (m.k12 * b2 - m.k22 * b1) / det;
+	x2 = (m.k12 * b1 - m.k11 * b2) / det;
+	if(x1 < 0 || x2 < 0)
+	{
+		x1 = -b1 / m.k11;
+		x2 = 0;
+		if(x1 < 0 || m.k12 * x1 + b2 < 0)
+		{
+			x1 = 0;
+			x2 = -b2 / m.k22;
+			if(x2 < 0 || m.k12 * x2 + b1 < 0)
+			{
+				if(b1 < 0 || b2 < 0)
+					return;
+				x1 = 0;
+				x2 = 0;
+			}
+		}
+	}
+
+	ApplyContactImpulse(m, c1, m.normal * (x1 - a1));
+	ApplyContactImpulse(m, c2, m.normal * (x2 - a2));
+	c1.normal_impulse = x1;
+	c2.normal_impulse = x2;
+}
+
+// Solves one island's contacts with sequential impulses, then moves its bodies.
+static void SolveIsland(u32 island)
+{
+	float inv_dt = 1 / g_timestep;
+	u32 first = g_island_manifold_starts[island];
+	u32 last = g_island_manifold_starts[island + 1];
+
+	// Precompute the effective masses and bias velocities, and apply the warm start impulses.
+	for(u32 i = first; i < last; ++i)
+	{
+		Manifold& m = g_manifolds[g_island_manifolds[i]];
+		f2 tangent = perp(m.normal);
+		float inv_mass = g_body_inv_masses[m.a] + g_body_inv_masses[m.b];
+		for(u32 j = 0; j < m.contact_count; ++j)
+		{
+			Contact& c = m.contacts[j];
+			c.ra = c.pos - g_body_positions[m.a];
+			c.rb = c.pos - g_body_positions[m.b];
+
+			float rna = cross(c.ra, m.normal), rnb = cross(c.rb, m.normal);
+			float rta = cross(c.ra, tangent), rtb = cross(c.rb, tangent);
+			c.normal_mass = 1 / (inv_mass + g_body_inv_inertias[m.a] * rna * rna + g_body_inv_inertias[m.b] * rnb * rnb);
+			c.tangent_mass = 1 / (inv_mass + g_body_inv_inertias[m.a] * rta * rta + g_body_inv_inertias[m.b] * rtb * rtb);
+
+			float closing_speed = dot(GetRelativeVelocity(m, c), m.normal);
+			c.bias = -BAUMGARTE * inv_dt * min(0.0f, c.separation + PENETRATION_SLOP);
+			if(closing_speed < -RESTITUTION_THRESHOLD)
+				c.bias = max(c.bias, -m.restitution * closing_speed);
+
+			ApplyContactImpulse(m, c, m.normal * c.normal_impulse + tangent * c.tangent_impulse);
+		}
+
+		// Two point manifolds are solved as a block, which keeps stacks from slowly rocking over, unless the points
+		// are so close together that the matrix is badly conditioned.
+		m.block_solve = false;
+		if(m.contact_count == 2)
+		{
+			const Contact& c1 = m.contacts[0];
+			const Contact& c2 = m.contacts[1];
+			float ia = g_body_inv_inertias[m.a], ib = g_body_inv_inertias[m.b];
+			float rn1a = cross(c1.ra, m.normal), rn1b = cross(c1.rb, m.normal);
+			float rn2a = cross(c2.ra, m.normal), rn2b = cross(c2.rb, m.normal);
+			m.k11 = inv_mass + ia * rn1a * rn1a + ib * rn1b * rn1b;
+			m.k22 = inv_mass + ia * rn2a * rn2a + ib * rn2b * rn2b;
+			m.k12 = inv_mass + ia * rn1a * rn2a + ib * rn1b * rn2b;
+			m.block_solve = m.k11 * m.k11 < 1000 * (m.k11 * m.k22 - m.k12 * m.k12);
+		}
+	}
+
+	for(u32 iteration = 0; iteration < g_iterations; ++iteration)
+	{
+		for(u32 i = first; i < last; ++i)
+		{
+			Manifold& m = g_manifolds[g_island_manifolds[i]];
+			f2 tangent = perp(m.normal);
+			// Friction, limited by the normal impulse.
+			for(u32 j = 0; j < m.contact_count; ++j)
+			{
+				Contact& c = m.contacts[j];
+				float max_friction = m.friction * c.normal_impulse;
+				float tangent_impulse = clamp(c.tangent_impulse - c.tangent_mass * dot(GetRelativeVelocity(m, c), tangent), -max_friction, max_friction);
+				ApplyContactImpulse(m, c, tangent * (tangent_impulse - c.tangent_impulse));
+				c.tangent_impulse = tangent_impulse;
+			}
+
+			// Non-penetration, which can only push.
+			if(m.block_solve)
+			{
+				SolveContactBlock(m);
+				continue;
+			}
+			for(u32 j = 0; j < m.contact_count; ++j)
+			{
+				Contact& c = m.contacts[j];
+				float normal_impulse = max(c.normal_impulse + c.normal_mass * (c.bias - dot(GetRelativeVelocity(m, c), m.normal)), 0.0f);
+				ApplyContactImpulse(m, c, m.normal * (normal_impulse - c.normal_impulse));
+				c.normal_impulse = normal_impulse;
+			}
+		}
+	}
+
+	// Move the bodies, and put the island to sleep if it has been still for long enough.
+	float island_sleep_time = SLEEP_TIME;
+	for(u32 i = g_island_body_starts[island]; i < g_island_body_starts[island + 1]; ++i)
+	{
+		u32 body = g_island_bodies[i];
+		g_body_positions[body] += g_body_velocities[body] * g_timestep;
+		g_body_rotations[body] += g_body_angular_velocities[body] * g_timestep;
+		g_body_moved[body] = true;
+
+		bool still = squared_len(g_body_velocities[body]) < SLEEP_LINEAR_SPEED * SLEEP_LINEAR_SPEED
+				  && fabs(g_body_angular_velocities[body]) < SLEEP_ANGULAR_SPEED;
+		g_body_sleep_times[body] = still ? g_body_sleep_times[body] + g_timestep : 0;
+		island_sleep_time = min(island_sleep_time, g_body_sleep_times[body]);
+	}
+
+	if(island_sleep_time >= SLEEP_TIME)
+	{
+		u32 first_body = g_island_body_starts[island];
+		u32 last_body = g_island_body_starts[island + 1];
+		for(u32 i = first_body; i < last_body; ++i)
+		{
+			u32 body = g_island_bodies[i];
+			g_body_awake[body] = false;
+			g_body_velocities[body] = f2(0);
+			g_body_angular_velocities[body] = 0;
+			g_body_island_next[body] = g_island_bodies[i + 1 < last_body ? i + 1 : first_body];
+		}
+	}
+}
+
+static void SolveIslandJob(void*, u32 island)
+{
+	SolveIsland(island);
+}
+
+static void StepPhysics()
+{
+	PROFILE_SCOPE("PhysicsStep");
+
+	for(u32 i = 0; i < g_total_bodies; ++i)
+	{
+		if(g_body_awake[i])
+			g_body_velocities[i] += g_gravity * g_timestep;
+	}
+
+	FindContacts();
+	BuildIslands();
+
+	// Islands share no dynamic bodies or manifolds, so they can be solved in parallel, and come out the same
+	// whichever thread solves them.
+	u32 island_count = u32(g_island_body_starts.size()) - 1;
+	RunJobs(SolveIslandJob, nullptr, island_count);
+
+	for(u16 body : g_island_bodies)
+		UpdateBodyCollider(body);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public physics API
+//////////////////////////////////////////////////////////////////////////
+
+BodyId CreateCircleBody(f2 pos, float radius, float density)
+{
+	float mass = density * float(PI) * radius * radius;
+	return CreateBody(BodyShape::Circle, pos, f2(radius, 0), mass, mass * radius * radius * 0.5f);
+}
+
+BodyId CreateBoxBody(f2 pos, f2 size, float density)
+{
+	float mass = density * size.x * size.y;
+	return CreateBody(BodyShape::Box, pos, size * 0.5f, mass, mass * squared_len(size) / 12);
+}
+
+void DestroyBody(BodyId body)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	if(idx == MAX_BODIES)
+		return;
+
+	// Wake anything resting on the body, and take it out of its sleeping island.
+	WakeBodiesNear(idx);
+	g_collider_bodies[g_body_colliders[idx] & 0xFFFFF] = NO_BODY;
+	DestroyCollider(g_body_colliders[idx]);
+	g_body_shapes[idx] = BodyShape::None;
+	g_body_awake[idx] = false;
+	g_body_inv_masses[idx] = 0;
+	g_body_next_free[idx] = g_body_free_head;
+	g_body_free_head = u16(idx);
+}
+
+void BindBodyToSprite(BodyId body, SpriteId sprite)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	if(idx == MAX_BODIES)
+		return;
+
+	g_body_sprites[idx] = sprite;
+	SyncBodySprite(idx);
+}
+
+f2 GetBodyPosition(BodyId body)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	return idx < MAX_BODIES ? g_body_positions[idx] : f2(0);
+}
+
+float GetBodyRotation(BodyId body)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	return idx < MAX_BODIES ? g_body_rotations[idx] : 0;
+}
+
+f2 GetBodyVelocity(BodyId body)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	return idx < MAX_BODIES ? g_body_velocities[idx] : f2(0);
+}
+
+bool IsBodyAwake(BodyId body)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	return idx < MAX_BODIES && g_body_awake[idx];
+}
+
+void SetBodyPosition(BodyId body, f2 pos)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	if(idx == MAX_BODIES)
+		return;
+
+	WakeBodiesNear(idx);
+	g_body_positions[idx] = pos;
+	UpdateBodyCollider(idx);
+	SyncBodySprite(idx);
+}
+
+void SetBodyRotation(BodyId body, float ang)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	if(idx == MAX_BODIES)
+		return;
+
+	WakeBodiesNear(idx);
+	g_body_rotations[idx] = ang;
+	UpdateBodyCollider(idx);
+	SyncBodySprite(idx);
+}
+
+void SetBodyVelocity(BodyId body, f2 vel)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	if(idx == MAX_BODIES || !IsDynamic(idx))
+		return;
+
+	WakeBody(idx);
+	g_body_velocities[idx] = vel;
+}
+
+void SetBodyMaterial(BodyId body, float restitution, float friction)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	if(idx == MAX_BODIES)
+		return;
+
+	g_body_restitutions[idx] = restitution;
+	g_body_frictions[idx] = friction;
+}
+
+void ApplyImpulse(BodyId body, f2 impulse)
+{
+	u32 idx = GetCheckedBodyIndex(body);
+	if(idx == MAX_BODIES || !IsDynamic(idx))
+		return;
+
+	WakeBody(idx);
+	g_body_velocities[idx] += impulse * g_body_inv_masses[idx];
+}
+
+void SetGravity(f2 gravity)
+{
+	g_gravity = gravity;
+
+	// Resting bodies need to notice the change.
+	for(u32 i = 0; i < g_total_bodies; ++i)
+		WakeBody(i);
+}
+
+void SetPhysicsTimestep(float seconds)
+{
+	g_timestep = max(seconds, 0.0001f);
+}
+
+void SetPhysicsIterations(u32 iterations)
+{
+	g_iterations = max(iterations, 1u);
+}
+
+void SetPhysicsPaused(bool b)
+{
+	g_physics_paused = b;
+}
+
+u32 GetAwakeBodyCount()
+{
+	u32 count = 0;
+	for(u32 i = 0; i < g_total_bodies; ++i)
+		count += g_body_awake[i] ? 1 : 0;
+	return count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Internal physics API
+//////////////////////////////////////////////////////////////////////////
+
+void PhysicsStartFrame(float frame_time)
+{
+	if(g_physics_paused || g_total_bodies == 0)
+		return;
+
+	g_time_accumulator += frame_time;
+	u32 steps = 0;
+	for(; g_time_accumulator >= g_timestep && steps < MAX_STEPS_PER_FRAME; ++steps)
+	{
+		StepPhysics();
+		g_time_accumulator -= g_timestep;
+	}
+	g_time_accumulator = min(g_time_accumulator, g_timestep);
+	if(steps == 0)
+		return;
+
+	// Move the bound sprites of bodies that moved, in bulk.
+	static std::vector<SpriteId> sprites;
+	static std::vector<f2> positions;
+	static std::vector<float> rotations;
+	sprites.clear();
+	positions.clear();
+	rotations.clear();
+	for(u32 i = 0; i < g_total_bodies; ++i)
+	{
+		if(g_body_moved[i] && g_body_sprites[i] != SpriteId(-1))
+		{
+			sprites.push_back(g_body_sprites[i]);
+			positions.push_back(g_body_positions[i]);
+			rotations.push_back(g_body_rotations[i]);
+		}
+		g_body_moved[i] = false;
+	}
+	if(!sprites.empty())
+	{
+		SetPositions(&sprites[0], &positions[0], u32(sprites.size()));
+		SetRotations(&sprites[0], &rotations[0], u32(sprites.size()));
+	}
+}
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Overview
+//////////////////////////////////////////////////////////////////////////
+/*
+	A simple 2D rigid body physics library, for circles and boxes.
+
+	The world is stepped at a fixed timestep at the start of each frame,
+	and contacts are resolved with sequential impulses. Bodies resting
+	together are grouped into islands, which are put to sleep (and skipped
+	entirely) until something disturbs them.
+
+	Bodies can be bound to sprites, in which case the sprites are moved to
+	match their bodies after each frame's steps.
+
+	Enabled by setting INCLUDE_PHYSICS to 1 in core.h. Uses the collision
+	library (collision.h) as its broadphase, and solves islands in parallel
+	with the job system (jobs.h), so build collision.cpp and jobs.cpp too.
+
+	Positions are body centres, and angles are in radians. Sprites bound to
+	bodies are placed at the centre, so create them with SpriteOrigin::Centre.
+*/
+
+//////////////////////////////////////////////////////////////////////////
+// Public physics API
+//////////////////////////////////////////////////////////////////////////
+
+// Bodies. A density of 0 makes a static body, which never moves.
+BodyId	CreateCircleBody(f2 pos, float radius, float density = 1);
+BodyId	CreateBoxBody(f2 pos, f2 size, float density = 1);
+void	DestroyBody(BodyId body);
+void	BindBodyToSprite(BodyId body, SpriteId sprite);	// The sprite needs a centre origin. Pass -1 to unbind.
+
+// Body state. Setting any of these wakes the body.
+f2		GetBodyPosition(BodyId body);
+float	GetBodyRotation(BodyId body);
+f2		GetBodyVelocity(BodyId body);
+bool	IsBodyAwake(BodyId body);
+void	SetBodyPosition(BodyId body, f2 pos);
+void	SetBodyRotation(BodyId body, float ang);
+void	SetBodyVelocity(BodyId body, f2 vel);
+void	SetBodyMaterial(BodyId body, float restitution, float friction);
+void	ApplyImpulse(BodyId body, f2 impulse);
+
+// World settings.
+void	SetGravity(f2 gravity);					// Defaults to (0, 980), i.e. 9.8m/s^2 down at 100 pixels per metre.
+void	SetPhysicsTimestep(float seconds);		// Defaults to 1/60.
+void	SetPhysicsIterations(u32 iterations);	// Solver iterations per step, defaults to 8.
+void	SetPhysicsPaused(bool b);
+u32		GetAwakeBodyCount();
+
+//////////////////////////////////////////////////////////////////////////
+// Internal physics API
+//////////////////////////////////////////////////////////////////////////
+
+void PhysicsStartFrame(float frame_time);
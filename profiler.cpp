@@ -0,0 +1,247 @@
+#include "core.h"
+#include <algorithm>
+#include <chrono>
+
+#if INCLUDE_PROFILER
+
+//////////////////////////////////////////////////////////////////////////
+// Internal types
+//////////////////////////////////////////////////////////////////////////
+
+static const u32 MAX_PROFILE_FRAMES	= 120;
+static const u32 MAX_PROFILE_ZONES	= 1024;
+static const u32 MAX_PROFILE_DEPTH	= 32;
+static const u32 NO_PROFILE_ZONE	= u32(-1);
+
+struct ProfileZone
+{
+	const char* name;
+	u64 start_ns;
+	u64 end_ns;
+	u32 depth;
+	u32 calls;
+};
+
+struct ProfileFrame
+{
+	u64 start_ns;
+	u64 end_ns;
+	u32 zone_count;
+	u32 dropped_zones;
+	ProfileZone zones[MAX_PROFILE_ZONES];
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Internal state
+//////////////////////////////////////////////////////////////////////////
+
+static ProfileFrame	g_profile_frames[MAX_PROFILE_FRAMES];
+static u32			g_profile_frame = 0;			// Ring buffer index of the frame being recorded.
+static u64			g_profile_frames_recorded = 0;
+static bool			g_profile_frame_started = false;	// Until the first ProfilerStartFrame(), zones aren't part of a frame.
+static u32			g_open_zones[MAX_PROFILE_DEPTH];
+static u32			g_zone_depth = 0;
+static bool			g_profiler_paused = false;		// Stops the overlay from profiling itself.
+
+static const std::chrono::steady_clock::time_point g_profile_epoch = std::chrono::steady_clock::now();
+
+//////////////////////////////////////////////////////////////////////////
+// Internal helpers
+//////////////////////////////////////////////////////////////////////////
+
+static u64 ProfilerNow()
+{
+	return u64(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_profile_epoch).count());
+}
+
+// Number of completed frames in the history.
+static u32 CompletedFrameCount()
+{
+	return u32(min<u64>(g_profile_frames_recorded, MAX_PROFILE_FRAMES - 1));
+}
+
+// Returns a completed frame, where 0 is the most recent.
+static const ProfileFrame& CompletedFrame(u32 age)
+{
+	return g_profile_frames[(g_profile_frame + MAX_PROFILE_FRAMES - 1 - age) % MAX_PROFILE_FRAMES];
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Internal profiler API
+//////////////////////////////////////////////////////////////////////////
+
+void ProfilerBeginZone(const char* name)
+{
+	if(g_profiler_paused)
+		return;
+
+	u32 depth = g_zone_depth++;
+	if(depth >= MAX_PROFILE_DEPTH)
+		return;
+
+	ProfileFrame& frame = g_profile_frames[g_profile_frame];
+
+	// Repeat calls to the zone that just finished at this depth are merged into it.
+	if(frame.zone_count > 0)
+	{
+		ProfileZone& last = frame.zones[frame.zone_count - 1];
+		if(last.name == name && last.depth == depth)
+		{
+			++last.calls;
+			g_open_zones[depth] = frame.zone_count - 1;
+			return;
+		}
+	}
+
+	if(frame.zone_count == MAX_PROFILE_ZONES)
+	{
+		++frame.dropped_zones;
+		g_open_zones[depth] = NO_PROFILE_ZONE;
+		return;
+	}
+
+	ProfileZone& zone = frame.zones[frame.zone_count];
+	zone.name = name;
+	zone.start_ns = ProfilerNow();
+	zone.end_ns = zone.start_ns;
+	zone.depth = depth;
+	zone.calls = 1;
+	g_open_zones[depth] = frame.zone_count++;
+}
+
+void ProfilerEndZone()
+{
+	if(g_profiler_paused || g_zone_depth == 0)
+		return;
+
+	u32 depth = --g_zone_depth;
+	if(depth >= MAX_PROFILE_DEPTH || g_open_zones[depth] == NO_PROFILE_ZONE)
+		return;
+
+	g_profile_frames[g_profile_frame].zones[g_open_zones[depth]].end_ns = ProfilerNow();
+}
+
+void ProfilerStartFrame()
+{
+	u64 now = ProfilerNow();
+
+	// Everything before the first frame (e.g. loading) isn't counted as a frame, so doesn't skew the history.
+	if(g_profile_frame_started)
+	{
+		g_profile_frames[g_profile_frame].end_ns = now;
+		g_profile_frame = (g_profile_frame + 1) % MAX_PROFILE_FRAMES;
+		++g_profile_frames_recorded;
+	}
+	g_profile_frame_started = true;
+
+	ProfileFrame& frame = g_profile_frames[g_profile_frame];
+	frame.start_ns = now;
+	frame.end_ns = now;
+	frame.zone_count = 0;
+	frame.dropped_zones = 0;
+
+	// Zones still open across the frame boundary belong to the old frame.
+	for(u32 i = 0; i < MAX_PROFILE_DEPTH; ++i)
+		g_open_zones[i] = NO_PROFILE_ZONE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public profiler API
+//////////////////////////////////////////////////////////////////////////
+
+void DrawProfilerOverlay(f2 pos, f2 size)
+{
+	u32 frame_count = CompletedFrameCount();
+	if(frame_count == 0)
+		return;
+
+	g_profiler_paused = true;
+
+	// Frame time percentiles over the history.
+	float frame_ms[MAX_PROFILE_FRAMES];
+	for(u32 i = 0; i < frame_count; ++i)
+		frame_ms[i] = (CompletedFrame(i).end_ns - CompletedFrame(i).start_ns) / 1000000.0f;
+	std::sort(frame_ms, frame_ms + frame_count);
+	float p50 = frame_ms[frame_count * 50 / 100];
+	float p95 = frame_ms[frame_count * 95 / 100];
+	float p99 = frame_ms[frame_count * 99 / 100];
+
+	// Flame bar for the last frame, one row per zone depth.
+	const ProfileFrame& frame = CompletedFrame(0);
+	float frame_ns = float(max<u64>(frame.end_ns - frame.start_ns, 1));
+	float text_height = 16;
+	float row_height = (size.y - text_height) / 8;
+
+	DrawQuad(pos, size, f4(0, 0, 0, 0.6f));
+	for(u32 i = 0; i < frame.zone_count; ++i)
+	{
+		const ProfileZone& zone = frame.zones[i];
+		if(zone.depth >= 8)
+			continue;
+
+		// Colour zones by name, so the same zone keeps its colour between frames.
+		u32 hash = 2166136261u;
+		for(const char* c = zone.name; *c; ++c)
+			hash = (hash ^ u8(*c)) * 16777619u;
+		f4 col = f4(HsvToRgb(f3((hash % 360) / 360.0f, 0.5f, 0.9f)), 1);
+
+		float x = size.x * ((zone.start_ns - frame.start_ns) / frame_ns);
+		float w = max(size.x * ((zone.end_ns - zone.start_ns) / frame_ns), 1.0f);
+		f2 zone_pos = pos + f2(x, text_height + zone.depth * row_height);
+		DrawQuad(zone_pos, f2(w, row_height - 1), col);
+
+		if(w > 80)
+		{
+			char label[64];
+			snprintf(label, sizeof(label), "%s x%u", zone.name, zone.calls);
+			PushFontStyle();
+			SetFontSize(u32(row_height * 0.6f));
+			SetFontColour(f4(0, 0, 0, 1));
+			DrawText(label, zone_pos + f2(2, 0), TextAlign::Left);
+			PopFontStyle();
+		}
+	}
+
+	char summary[128];
+	snprintf(summary, sizeof(summary), "%.2fms  p50 %.2fms  p95 %.2fms  p99 %.2fms%s",
+		(frame.end_ns - frame.start_ns) / 1000000.0f, p50, p95, p99, frame.dropped_zones ? "  (zones dropped)" : "");
+	PushFontStyle();
+	SetFontSize(u32(text_height * 0.75f));
+	SetFontColour(f4(1));
+	DrawText(summary, pos, TextAlign::Left);
+	PopFontStyle();
+
+	g_profiler_paused = false;
+}
+
+bool ExportProfilerTrace(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if(!file)
+	{
+		printf("[ERR]: Couldn't open profiler trace file %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for(u32 age = CompletedFrameCount(); age-- > 0;)
+	{
+		const ProfileFrame& frame = CompletedFrame(age);
+		fprintf(file, "%s{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+			first ? "" : ",\n", frame.start_ns / 1000.0, (frame.end_ns - frame.start_ns) / 1000.0);
+		first = false;
+
+		for(u32 i = 0; i < frame.zone_count; ++i)
+		{
+			const ProfileZone& zone = frame.zones[i];
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"calls\":%u}}",
+				zone.name, zone.start_ns / 1000.0, (zone.end_ns - zone.start_ns) / 1000.0, zone.calls);
+		}
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////
+// Overview
+//////////////////////////////////////////////////////////////////////////
+/*
+	A lightweight scoped-zone CPU profiler. Zones are recorded into a ring
+	buffer of recent frames, which can be drawn as an on-screen overlay, or
+	exported as Chrome trace JSON (load it in chrome://tracing).
+
+	Consecutive calls to the same zone (e.g. thousands of DrawQuad calls in a
+	row) are merged into a single zone, with a call count.
+
+	Enabled by setting INCLUDE_PROFILER to 1 in core.h. When disabled, the
+	PROFILE_SCOPE macro compiles to nothing.
+*/
+
+//////////////////////////////////////////////////////////////////////////
+// Public profiler API
+//////////////////////////////////////////////////////////////////////////
+
+// Profiles the rest of the enclosing scope. The name must be a string literal (or otherwise outlive the profiler history).
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+// Draws a flame bar of the previous frame's zones, along with frame time percentiles. Uses the current font for labels.
+void	DrawProfilerOverlay(f2 pos, f2 size);
+
+// Writes all frames in the history as Chrome trace JSON.
+bool	ExportProfilerTrace(const char* path);
+
+//////////////////////////////////////////////////////////////////////////
+// Internal profiler API
+//////////////////////////////////////////////////////////////////////////
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+void ProfilerBeginZone(const char* name);
+void ProfilerEndZone();
+void ProfilerStartFrame();
+
+struct ProfileScope
+{
+	ProfileScope(const char* name)	{ ProfilerBeginZone(name); }
+	~ProfileScope()					{ ProfilerEndZone(); }
+};
@@ -0,0 +1,46 @@
+//////////////////////////////////////////////////////////////////////////
+// Antialiasing toggle check
+//////////////////////////////////////////////////////////////////////////
+/*
+	Toggles window antialiasing between frames, checking that each frame
+	shows its own clear colour rather than a stale offscreen scene. Needs a
+	display (or a virtual one), as antialiased windows can't be headless.
+	Returns non-zero on failure.
+
+	Build with core.cpp and maths.cpp, linking SFML as for the library.
+*/
+
+#include "../core.h"
+
+static const char* CAPTURE_PATH = "antialias_toggle.png";
+
+// Clears a frame to the given colour, and checks the captured frame matches.
+static bool CheckFrame(f4 colour, const char* description)
+{
+	SetWindowClearColour(colour);
+	StartFrame();
+	SaveFrameToFile(GetFrameNumber(), CAPTURE_PATH);
+	StartFrame();
+
+	sf::Image frame;
+	bool success = frame.loadFromFile(CAPTURE_PATH);
+	remove(CAPTURE_PATH);
+	sf::Color expected(u8(colour.x * 255), u8(colour.y * 255), u8(colour.z * 255));
+	sf::Color actual = success ? frame.getPixel(frame.getSize().x / 2, frame.getSize().y / 2) : sf::Color::Transparent;
+	success = success && actual.r == expected.r && actual.g == expected.g && actual.b == expected.b;
+	printf("%s: %s\n", description, success ? "passed" : "FAILED");
+	return success;
+}
+
+int main()
+{
+	SetWindowSize(320, 240);
+	CoreInit();
+
+	bool success = CheckFrame(f4(1, 0, 0, 1), "Offscreen");
+	SetWindowAntialiased(true);
+	success = CheckFrame(f4(0, 1, 0, 1), "Antialiased after offscreen") && success;
+	SetWindowAntialiased(false);
+	success = CheckFrame(f4(0, 0, 1, 1), "Offscreen after antialiased") && success;
+	return success ? 0 : 1;
+}